@@ -0,0 +1,224 @@
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <span>
+#include <stdexcept>
+
+#include "RingBuffer.h"
+
+// Tiny executor hook for AsyncRingBuffer.
+// When one side of a ring frees space or publishes data, the coroutine parked on
+// the other side is handed to schedule() rather than resumed inline. That way a
+// producer never ends up running its consumer from inside advanceWriteHead (and
+// vice versa), and one thread can drive as many rings as it likes.
+//
+// The default impl just queues the handles; call run() from your loop. Override
+// schedule() to push the handles into whatever loop you already have.
+class RingExecutor {
+public:
+	virtual ~RingExecutor() {}
+
+	virtual void schedule(std::coroutine_handle<> handle) { _ready.push_back(handle); }
+
+	// Resumes queued coroutines until the queue is empty, including the ones
+	// scheduled while running. Returns the number of resumed coroutines.
+	size_t run();
+
+	bool hasWork() const { return !_ready.empty(); }
+
+private:
+	std::deque<std::coroutine_handle<>> _ready;
+};
+
+inline size_t RingExecutor::run()
+{
+	size_t resumed = 0;
+
+	while (!_ready.empty())
+	{
+		std::coroutine_handle<> handle = _ready.front();
+		_ready.pop_front();
+		handle.resume();
+		resumed++;
+	}
+
+	return resumed;
+}
+
+// Fire and forget coroutine type. Enough to write producers and consumers as
+// plain functions that co_await a ring. The frame cleans itself up when done.
+// An exception escaping the body goes to whoever started or resumed the
+// coroutine (the caller, or RingExecutor::run) instead of terminating. The
+// frame is leaked then : it's for caller mistakes, not for control flow.
+struct RingTask {
+	struct promise_type {
+		RingTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { throw; }
+	};
+};
+
+// RingBuffer with awaitable reads and writes.
+//
+//   std::span<T> data = co_await ring.readable(n);   // at least n buckets
+//   ... consume ...
+//   ring.advanceReadHead(count);                      // may wake the writer
+//
+//   std::span<T> space = co_await ring.writable(n);   // at least n free buckets
+//   ... fill ...
+//   ring.advanceWriteHead(count);                     // may wake the reader
+//
+// Spans are contiguous thanks to VMemMirrorBuffer, no matter where the heads are.
+// One reader and one writer at a time, all on the executor's thread. Like RingBuffer,
+// this is not thread safe.
+template <typename T>
+class AsyncRingBuffer {
+public:
+	class ReadAwaiter;
+	class WriteAwaiter;
+
+	AsyncRingBuffer(size_t nbBuckets, RingExecutor& executor);
+
+	AsyncRingBuffer(const AsyncRingBuffer&) = delete;
+	AsyncRingBuffer& operator=(const AsyncRingBuffer&) = delete;
+
+	// Resumes once availableForRead() >= n. Yields the whole readable region.
+	// Throws if n can never be satisfied (n > availableBuckets), or if another
+	// coroutine is already waiting to read.
+	ReadAwaiter readable(size_t n = 1);
+
+	// Resumes once availableForWrite() >= n. Yields the whole writable region.
+	// Throws like readable().
+	WriteAwaiter writable(size_t n = 1);
+
+	// Same as the RingBuffer ones, but they resume the other side when its
+	// request can be satisfied.
+	void advanceReadHead(size_t offset);
+	void advanceWriteHead(size_t offset);
+
+	RingBuffer<T>& ring() { return _ring; }
+
+	class ReadAwaiter {
+	public:
+		ReadAwaiter(AsyncRingBuffer& owner, size_t n) : _owner{ owner }, _n{ n } {}
+
+		bool await_ready() const { return _owner._ring.availableForRead() >= _n; }
+		void await_suspend(std::coroutine_handle<> handle) { _owner.park(_owner._reader, handle, _n); }
+		std::span<T> await_resume() { return { _owner._ring.readBuffer(), _owner._ring.availableForRead() }; }
+
+	private:
+		AsyncRingBuffer& _owner;
+		size_t _n;
+	};
+
+	class WriteAwaiter {
+	public:
+		WriteAwaiter(AsyncRingBuffer& owner, size_t n) : _owner{ owner }, _n{ n } {}
+
+		bool await_ready() const { return _owner._ring.availableForWrite() >= _n; }
+		void await_suspend(std::coroutine_handle<> handle) { _owner.park(_owner._writer, handle, _n); }
+		std::span<T> await_resume() { return { _owner._ring.writeBuffer(), _owner._ring.availableForWrite() }; }
+
+	private:
+		AsyncRingBuffer& _owner;
+		size_t _n;
+	};
+
+private:
+	struct Waiter {
+		std::coroutine_handle<> handle{};
+		size_t wants{ 0 };
+	};
+
+	// Throws if waiting for n on that side can't work. Done before the awaiter
+	// exists, rather than from await_suspend.
+	void checkWait(const Waiter& waiter, size_t n) const;
+
+	void park(Waiter& waiter, std::coroutine_handle<> handle, size_t n);
+	void wake(Waiter& waiter, size_t available);
+
+private:
+	RingBuffer<T> _ring;
+	RingExecutor& _executor;
+
+	Waiter _reader{};
+	Waiter _writer{};
+};
+
+template <typename T>
+AsyncRingBuffer<T>::AsyncRingBuffer(size_t nbBuckets, RingExecutor& executor)
+	: _ring{ nbBuckets }
+	, _executor{ executor }
+{
+}
+
+template <typename T>
+typename AsyncRingBuffer<T>::ReadAwaiter AsyncRingBuffer<T>::readable(size_t n)
+{
+	checkWait(_reader, n);
+	return ReadAwaiter{ *this, n };
+}
+
+template <typename T>
+typename AsyncRingBuffer<T>::WriteAwaiter AsyncRingBuffer<T>::writable(size_t n)
+{
+	checkWait(_writer, n);
+	return WriteAwaiter{ *this, n };
+}
+
+template <typename T>
+void AsyncRingBuffer<T>::advanceReadHead(size_t offset)
+{
+	_ring.advanceReadHead(offset);
+	wake(_writer, _ring.availableForWrite());
+}
+
+template <typename T>
+void AsyncRingBuffer<T>::advanceWriteHead(size_t offset)
+{
+	_ring.advanceWriteHead(offset);
+	wake(_reader, _ring.availableForRead());
+}
+
+template <typename T>
+void AsyncRingBuffer<T>::checkWait(const Waiter& waiter, size_t n) const
+{
+	if (n > _ring.availableBuckets())
+	{
+		throw std::runtime_error{ "AsyncRingBuffer can't wait for more than availableBuckets" };
+	}
+
+	if (waiter.handle)
+	{
+		throw std::runtime_error{ "AsyncRingBuffer supports a single waiter per side" };
+	}
+}
+
+template <typename T>
+void AsyncRingBuffer<T>::park(Waiter& waiter, std::coroutine_handle<> handle, size_t n)
+{
+	if (waiter.handle)
+	{
+		throw std::runtime_error{ "AsyncRingBuffer supports a single waiter per side" };
+	}
+
+	waiter.handle = handle;
+	waiter.wants = n;
+}
+
+template <typename T>
+void AsyncRingBuffer<T>::wake(Waiter& waiter, size_t available)
+{
+	if (!waiter.handle || available < waiter.wants)
+	{
+		return;
+	}
+
+	std::coroutine_handle<> handle = waiter.handle;
+	waiter = {};
+	_executor.schedule(handle);
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "RingBuffer.h"
+
+// Bit level access to a RingBuffer<uint8_t>, LSB first (DEFLATE order).
+//
+// Every read is one unaligned 8 bytes load and every write one unaligned 8 bytes
+// store at the current byte, whatever the position : near the end of the buffer
+// the access just runs into the second view of the mirror. No refill logic, no
+// wrap check, the position only wraps with a conditional subtract when it moves.
+// Fields are up to MaxBits wide.
+//
+// The ring heads move in whole bytes, when asked to (BitWriter::commit,
+// BitReader::release) : a batch of fields costs one head update. Don't touch
+// the ring's heads otherwise while a reader or writer is working on it.
+
+namespace BitStream {
+	// A 7 bits offset in the current byte + 56 bits still fit one 64 bits load.
+	constexpr unsigned MaxBits = 56;
+
+	inline uint64_t lowBits(unsigned nbBits) { return (uint64_t{ 1 } << nbBits) - 1; }
+};
+
+class BitWriter {
+public:
+	BitWriter(RingBuffer<uint8_t>& ring);
+
+	// Appends the nbBits low bits of value, nbBits <= MaxBits. Throws if the
+	// ring doesn't have 8 bytes of headroom past the current byte, which the
+	// store needs (the bytes past the field are overwritten with garbage).
+	void write(uint64_t value, unsigned nbBits);
+
+	// Zero pads to the next byte boundary.
+	void alignToByte();
+
+	// Publishes the completed bytes : moves the ring's write head. A partly
+	// written byte stays with the writer.
+	void commit();
+
+	// Bits written and not committed yet.
+	size_t pendingBits() const { return _pendingBytes * 8 + _bitCount; }
+
+private:
+	void advance(size_t bytes)
+	{
+		_position += bytes;
+		_position -= (_position >= _size) ? _size : 0;
+		_pendingBytes += bytes;
+	}
+
+private:
+	RingBuffer<uint8_t>* _ring;
+	uint8_t* _base;
+	size_t _size;
+
+	// Byte the accumulator goes to, and how far past the ring's write head it is.
+	size_t _position;
+	size_t _pendingBytes{ 0 };
+
+	// Bits of the current byte not completed yet.
+	uint64_t _accumulator{ 0 };
+	unsigned _bitCount{ 0 };
+
+	// Bytes the writer may go past the write head, as of the last check.
+	size_t _limit{ 0 };
+};
+
+class BitReader {
+public:
+	BitReader(RingBuffer<uint8_t>& ring);
+
+	// nbBits <= MaxBits. Reading more than bitsAvailable() returns garbage, it
+	// doesn't fail : check bitsAvailable() for a whole batch beforehand.
+	uint64_t peek(unsigned nbBits) const;
+	void skip(unsigned nbBits);
+	uint64_t read(unsigned nbBits);
+
+	void alignToByte();
+
+	// Gives the fully read bytes back to the ring : moves its read head.
+	void release();
+
+	size_t bitsAvailable() const { return (_ring->availableForRead() - _consumedBytes) * 8 - _bitOffset; }
+
+private:
+	RingBuffer<uint8_t>* _ring;
+	const uint8_t* _base;
+	size_t _size;
+
+	size_t _position;
+	unsigned _bitOffset{ 0 };
+
+	// Bytes read past the ring's read head.
+	size_t _consumedBytes{ 0 };
+};
+
+inline BitWriter::BitWriter(RingBuffer<uint8_t>& ring)
+	: _ring{ &ring }, _base{ ring.rawBuffer() }, _size{ ring.bucketCount() },
+	_position{ static_cast<size_t>(ring.writeBuffer() - ring.rawBuffer()) }
+{
+}
+
+inline void BitWriter::write(uint64_t value, unsigned nbBits)
+{
+	if (_pendingBytes + 8 > _limit)
+	{
+		_limit = _ring->availableForWrite();
+		if (_pendingBytes + 8 > _limit)
+		{
+			throw std::runtime_error{ "BitWriter needs 8 bytes of headroom in the ring" };
+		}
+	}
+
+	_accumulator |= (value & BitStream::lowBits(nbBits)) << _bitCount;
+	_bitCount += nbBits;
+
+	memcpy(_base + _position, &_accumulator, sizeof(_accumulator));
+
+	unsigned bytes = _bitCount >> 3;
+	_accumulator >>= bytes * 8;
+	_bitCount &= 7;
+	advance(bytes);
+}
+
+inline void BitWriter::alignToByte()
+{
+	if (_bitCount != 0)
+	{
+		// Already stored by the last write, zero padded.
+		_accumulator = 0;
+		_bitCount = 0;
+		advance(1);
+	}
+}
+
+inline void BitWriter::commit()
+{
+	_ring->advanceWriteHead(_pendingBytes);
+	_limit -= (_limit >= _pendingBytes) ? _pendingBytes : _limit;
+	_pendingBytes = 0;
+}
+
+inline BitReader::BitReader(RingBuffer<uint8_t>& ring)
+	: _ring{ &ring }, _base{ ring.rawBuffer() }, _size{ ring.bucketCount() },
+	_position{ static_cast<size_t>(ring.readBuffer() - ring.rawBuffer()) }
+{
+}
+
+inline uint64_t BitReader::peek(unsigned nbBits) const
+{
+	uint64_t bits;
+	memcpy(&bits, _base + _position, sizeof(bits));
+
+	return (bits >> _bitOffset) & BitStream::lowBits(nbBits);
+}
+
+inline void BitReader::skip(unsigned nbBits)
+{
+	_bitOffset += nbBits;
+
+	size_t bytes = _bitOffset >> 3;
+	_bitOffset &= 7;
+
+	_position += bytes;
+	_position -= (_position >= _size) ? _size : 0;
+	_consumedBytes += bytes;
+}
+
+inline uint64_t BitReader::read(unsigned nbBits)
+{
+	uint64_t value = peek(nbBits);
+	skip(nbBits);
+	return value;
+}
+
+inline void BitReader::alignToByte()
+{
+	skip((8 - _bitOffset) & 7);
+}
+
+inline void BitReader::release()
+{
+	_ring->advanceReadHead(_consumedBytes);
+	_consumedBytes = 0;
+}
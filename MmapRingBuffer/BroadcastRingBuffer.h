@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "RingBuffer.h"
+#include "VMemMirrorBuffer.h"
+
+// One producer, any number of readers, no back pressure.
+//
+// RingBuffer's overwrite mode moves the read head from the producer side, which
+// is fine on one thread but leaves a concurrent reader with torn data and no way
+// to tell. Here the producer never looks at the readers : it publishes a
+// monotonic sequence number and keeps going. Each Reader copies a span, then
+// checks (seqlock style) whether the producer lapped it while it was copying.
+// Torn elements are dropped, counted as lost, and the reader resyncs on the
+// oldest element that is still valid. Slow readers lose data, they never stall
+// the feed.
+//
+// All bucketCount() buckets are usable. Thread safe for one producer thread and
+// any number of reader threads, each with its own Reader.
+template <typename T>
+class BroadcastRingBuffer {
+	static_assert(std::is_trivial<T>::value, "BroadcastRingBuffer must be templated on a trivial type.");
+
+public:
+	class Reader;
+
+	// Rounds the size up the same way RingBuffer does.
+	BroadcastRingBuffer(size_t nbBuckets, RingSizing sizing = RingSizing::Pages);
+
+	BroadcastRingBuffer(const BroadcastRingBuffer&) = delete;
+	BroadcastRingBuffer& operator=(const BroadcastRingBuffer&) = delete;
+
+	size_t bucketCount() const { return _nbBuckets; }
+
+	// Number of elements published so far.
+	uint64_t sequence() const { return _published.load(std::memory_order_acquire); }
+
+	void write(const T& t);
+
+	// Batch write : claim(count) returns where to write count elements (count <=
+	// bucketCount, contiguous thanks to the mirror), publish() makes them visible.
+	// Readers treat the claimed buckets as overwritten right away.
+	T* claim(size_t count);
+	void publish();
+
+	// New reader, starting at the current end of the stream.
+	Reader reader() const { return Reader{ *this, sequence() }; }
+
+	class Reader {
+	public:
+		struct Result {
+			// Valid elements copied to the destination.
+			size_t count;
+			// Elements skipped because the producer overwrote them first.
+			uint64_t lost;
+		};
+
+		Reader(const BroadcastRingBuffer& ring, uint64_t position) : _ring{ &ring }, _position{ position } {}
+
+		// Copies up to max elements, oldest first.
+		Result read(T* dst, size_t max);
+
+		// Sequence number of the next element to read.
+		uint64_t position() const { return _position; }
+
+		// Published elements not read yet, lost ones included.
+		uint64_t pending() const { return _ring->sequence() - _position; }
+
+		uint64_t totalLost() const { return _lost; }
+
+	private:
+		// Elements before that are, or are being, overwritten.
+		uint64_t oldestValid() const;
+
+	private:
+		const BroadcastRingBuffer* _ring;
+		uint64_t _position;
+		uint64_t _lost{ 0 };
+	};
+
+private:
+	size_t wrap(uint64_t sequence) const { return static_cast<size_t>(_mask != 0 ? (sequence & _mask) : (sequence % _nbBuckets)); }
+
+private:
+	size_t _nbBuckets{ 0 };
+	size_t _mask{ 0 };
+	VMemMirrorBuffer _buffer{};
+
+	// _claimed moves before the producer touches the buffer, _published after.
+	// Own cache lines : readers hammer them, the producer writes them.
+	alignas(64) std::atomic<uint64_t> _claimed{ 0 };
+	alignas(64) std::atomic<uint64_t> _published{ 0 };
+};
+
+template <typename T>
+BroadcastRingBuffer<T>::BroadcastRingBuffer(size_t nbBuckets, RingSizing sizing)
+{
+	if (nbBuckets == 0)
+	{
+		throw std::runtime_error{ "size of buffer must be non-zero." };
+	}
+
+	_nbBuckets = (sizing == RingSizing::PowerOfTwo) ? std::bit_ceil(nbBuckets) : nbBuckets;
+	_nbBuckets = System::roundUpToPages(_nbBuckets, sizeof(T));
+	_mask = std::has_single_bit(_nbBuckets) ? _nbBuckets - 1 : 0;
+
+	_buffer.allocate(_nbBuckets * sizeof(T));
+}
+
+template <typename T>
+void BroadcastRingBuffer<T>::write(const T& t)
+{
+	*claim(1) = t;
+	publish();
+}
+
+template <typename T>
+T* BroadcastRingBuffer<T>::claim(size_t count)
+{
+	if (count > _nbBuckets)
+	{
+		throw std::runtime_error{ "BroadcastRingBuffer can't claim more than bucketCount" };
+	}
+
+	uint64_t start = _published.load(std::memory_order_relaxed);
+
+	// Seqlock writer : the claim has to be visible before any of the data writes.
+	_claimed.store(start + count, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	return &_buffer.getBuffer<T>()[wrap(start)];
+}
+
+template <typename T>
+void BroadcastRingBuffer<T>::publish()
+{
+	_published.store(_claimed.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+template <typename T>
+uint64_t BroadcastRingBuffer<T>::Reader::oldestValid() const
+{
+	uint64_t claimed = _ring->_claimed.load(std::memory_order_relaxed);
+	return claimed > _ring->_nbBuckets ? claimed - _ring->_nbBuckets : 0;
+}
+
+template <typename T>
+typename BroadcastRingBuffer<T>::Reader::Result BroadcastRingBuffer<T>::Reader::read(T* dst, size_t max)
+{
+	uint64_t published = _ring->_published.load(std::memory_order_acquire);
+	uint64_t lost = 0;
+
+	// Skip what's already known to be gone.
+	uint64_t oldest = oldestValid();
+	if (_position < oldest)
+	{
+		lost += oldest - _position;
+		_position = oldest;
+	}
+
+	// published was loaded first : if the producer lapped us since, start is
+	// past it. Nothing to copy then, the check below counts the loss.
+	uint64_t start = _position;
+	uint64_t ready = published > start ? published - start : 0;
+	ready = ready < _ring->_nbBuckets ? ready : _ring->_nbBuckets;
+	size_t count = ready < max ? static_cast<size_t>(ready) : max;
+
+	// Never more than bucketCount, so contiguous in the mirror.
+	memcpy(dst, &_ring->_buffer.template getBuffer<T>()[_ring->wrap(start)], count * sizeof(T));
+
+	// Seqlock reader : whatever the producer claimed while we were copying may be torn.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	oldest = oldestValid();
+
+	size_t torn = 0;
+	if (start < oldest)
+	{
+		torn = oldest - start < count ? static_cast<size_t>(oldest - start) : count;
+		lost += oldest - start;
+		memmove(dst, dst + torn, (count - torn) * sizeof(T));
+	}
+
+	_position = (start + count > oldest) ? start + count : oldest;
+	_lost += lost;
+
+	return Result{ count - torn, lost };
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "VMemMirrorBuffer.h"
+
+// Struct of arrays flavour of RingBuffer : each column lives in its own
+// VMemMirrorBuffer and all columns share a single pair of heads.
+//
+//   ColumnRingBuffer<double, uint32_t, int64_t> ticks{ 4096 };   // price, size, time
+//   ticks.write(price, size, time);
+//   std::span<double> prices = ticks.column<0>();
+//
+// A batch read gives one contiguous span per column, whatever the head
+// positions, so a vectorized consumer only loads the columns it needs.
+//
+// Same semantics as RingBuffer : nbBuckets - 1 usable buckets, writes past that
+// overwrite the oldest row. The bucket count is rounded up so every column fills
+// whole pages.
+template <typename... Ts>
+class ColumnRingBuffer {
+	static_assert(sizeof...(Ts) > 0, "ColumnRingBuffer needs at least one column.");
+	static_assert((std::is_trivial<Ts>::value && ...), "ColumnRingBuffer columns must be trivial types.");
+
+public:
+	static constexpr size_t ColumnCount = sizeof...(Ts);
+
+	template <size_t I>
+	using Column = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+	ColumnRingBuffer(size_t nbBuckets);
+
+	ColumnRingBuffer(const ColumnRingBuffer&) = delete;
+	ColumnRingBuffer& operator=(const ColumnRingBuffer&) = delete;
+
+	bool hasData() const { return _read != _write; }
+	bool isFull() const { return availableForRead() == _capacity; }
+
+	size_t availableBuckets() const { return _capacity; }
+	size_t bucketCount() const { return _nbBuckets; }
+	size_t availableForWrite() const { return _capacity - availableForRead(); }
+	size_t availableForRead() const { return wrap(_write + _nbBuckets - _read); }
+
+	// Writes one row, one value per column.
+	void write(const Ts&... values);
+
+	void reset();
+
+	// Readable region of column I.
+	template <size_t I>
+	std::span<Column<I>> column() { return { readBuffer<I>(), availableForRead() }; }
+
+	// Readable region of every column at once.
+	std::tuple<std::span<Ts>...> readSpans() { return readSpans(std::index_sequence_for<Ts...>{}); }
+
+	// Batch access, same rules as RingBuffer : fill the write buffers then
+	// advanceWriteHead, consume the read buffers then advanceReadHead.
+	template <size_t I>
+	Column<I>* readBuffer() { return &std::get<I>(_columns).template getBuffer<Column<I>>()[_read]; }
+
+	template <size_t I>
+	Column<I>* writeBuffer() { return &std::get<I>(_columns).template getBuffer<Column<I>>()[_write]; }
+
+	std::tuple<Ts*...> writeBuffers() { return writeBuffers(std::index_sequence_for<Ts...>{}); }
+
+	// UB if offset > availableForRead.
+	void advanceReadHead(size_t offset);
+
+	// UB if offset > availableBuckets
+	void advanceWriteHead(size_t offset);
+
+private:
+	size_t inc(size_t base) const { return wrap(base + 1); }
+	size_t wrap(size_t base) const { return _mask != 0 ? (base & _mask) : (base % _nbBuckets); }
+
+	template <size_t... Is>
+	void allocate(std::index_sequence<Is...>);
+
+	template <size_t... Is>
+	void writeRow(std::index_sequence<Is...>, const Ts&... values);
+
+	template <size_t... Is>
+	std::tuple<std::span<Ts>...> readSpans(std::index_sequence<Is...>) { return { column<Is>()... }; }
+
+	template <size_t... Is>
+	std::tuple<Ts*...> writeBuffers(std::index_sequence<Is...>) { return { writeBuffer<Is>()... }; }
+
+private:
+	size_t _nbBuckets{ 0 };
+	size_t _capacity{ 0 };
+	size_t _mask{ 0 };
+
+	// One mirrored buffer per column
+	std::array<VMemMirrorBuffer, ColumnCount> _columns{};
+
+	size_t _read{ 0 };
+	size_t _write{ 0 };
+};
+
+template <typename... Ts>
+ColumnRingBuffer<Ts...>::ColumnRingBuffer(size_t nbBuckets)
+	: _capacity{ nbBuckets - 1 }
+{
+	if (nbBuckets < 2)
+	{
+		throw std::runtime_error{ "nbBuckets must be at least 2." };
+	}
+
+	// Granularities are powers of 2 : the biggest one is a multiple of all the others.
+	size_t granularity = std::max({ System::pageGranularity(sizeof(Ts))... });
+	_nbBuckets = (nbBuckets + granularity - 1) / granularity * granularity;
+	_mask = std::has_single_bit(_nbBuckets) ? _nbBuckets - 1 : 0;
+
+	allocate(std::index_sequence_for<Ts...>{});
+}
+
+template <typename... Ts>
+template <size_t... Is>
+void ColumnRingBuffer<Ts...>::allocate(std::index_sequence<Is...>)
+{
+	(_columns[Is].allocate(_nbBuckets * sizeof(Ts)), ...);
+}
+
+template <typename... Ts>
+void ColumnRingBuffer<Ts...>::write(const Ts&... values)
+{
+	bool full = isFull();
+
+	writeRow(std::index_sequence_for<Ts...>{}, values...);
+
+	_write = inc(_write);
+	_read = full ? inc(_read) : _read;
+}
+
+template <typename... Ts>
+template <size_t... Is>
+void ColumnRingBuffer<Ts...>::writeRow(std::index_sequence<Is...>, const Ts&... values)
+{
+	((*writeBuffer<Is>() = values), ...);
+}
+
+template <typename... Ts>
+void ColumnRingBuffer<Ts...>::reset()
+{
+	_read = 0;
+	_write = 0;
+}
+
+template <typename... Ts>
+void ColumnRingBuffer<Ts...>::advanceReadHead(size_t offset)
+{
+	_read = wrap(_read + offset);
+}
+
+template <typename... Ts>
+void ColumnRingBuffer<Ts...>::advanceWriteHead(size_t offset)
+{
+	size_t nextWrite = wrap(_write + offset);
+	size_t nextRead = _read;
+
+	if (offset > availableForWrite()) {
+		// keep the newest _capacity rows
+		nextRead = wrap(nextWrite + _nbBuckets - _capacity);
+	}
+
+	_write = nextWrite;
+	_read = nextRead;
+}
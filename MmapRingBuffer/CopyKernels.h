@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <intrin.h>
+#include <immintrin.h>
+
+// Copy routines for bulk ring transfers.
+//
+// Small copies go through memcpy, which is already about as good as it gets.
+// Past StreamingThreshold, the destination is written with non temporal
+// (streaming) stores : data that only the consumer core will read doesn't get
+// pulled in the producer's cache and doesn't evict its working set. The widest
+// store the CPU supports is picked at runtime (AVX-512, AVX, SSE2 as a floor on x64).
+namespace CopyKernels {
+
+	enum class Level {
+		SSE2,
+		AVX2,
+		AVX512
+	};
+
+	// Copies of at least that many bytes use streaming stores.
+	constexpr size_t StreamingThreshold = 64 * 1024;
+
+	constexpr size_t CacheLine = 64;
+
+	inline Level detectLevel()
+	{
+		int info[4];
+
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return Level::SSE2;
+		}
+
+		// The OS has to save the wide registers too, that's what xgetbv tells.
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx)
+		{
+			return Level::SSE2;
+		}
+
+		unsigned long long xcr0 = _xgetbv(0);
+		if ((xcr0 & 0x6) != 0x6)
+		{
+			return Level::SSE2;
+		}
+
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) != 0;
+		bool avx512f = (info[1] & (1 << 16)) != 0;
+
+		if (avx512f && (xcr0 & 0xE6) == 0xE6)
+		{
+			return Level::AVX512;
+		}
+
+		return avx2 ? Level::AVX2 : Level::SSE2;
+	}
+
+	inline Level cpuLevel()
+	{
+		static const Level level = detectLevel();
+		return level;
+	}
+
+	// Streaming copy of whole cache lines. dst must be 64 bytes aligned, bytes a
+	// multiple of 64.
+	inline void streamLines(char* dst, const char* src, size_t bytes, Level level)
+	{
+		switch (level)
+		{
+		case Level::AVX512:
+			for (size_t i = 0; i < bytes; i += CacheLine)
+			{
+				_mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), _mm512_loadu_si512(src + i));
+			}
+			break;
+
+		case Level::AVX2:
+			for (size_t i = 0; i < bytes; i += CacheLine)
+			{
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+				_mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), a);
+				_mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 32), b);
+			}
+			break;
+
+		default:
+			for (size_t i = 0; i < bytes; i += CacheLine)
+			{
+				for (size_t j = 0; j < CacheLine; j += 16)
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + j));
+					_mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + j), v);
+				}
+			}
+			break;
+		}
+
+		// Streaming stores are weakly ordered, make them visible before whatever
+		// publishes the data (e.g. moving a head).
+		_mm_sfence();
+	}
+
+	// Copy with streaming stores regardless of size.
+	inline void streamCopy(void* dst, const void* src, size_t bytes)
+	{
+		char* d = static_cast<char*>(dst);
+		const char* s = static_cast<const char*>(src);
+
+		// Regular copy up to the first cache line of dst, and for the tail.
+		size_t head = (CacheLine - reinterpret_cast<uintptr_t>(d) % CacheLine) % CacheLine;
+		head = head < bytes ? head : bytes;
+
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		bytes -= head;
+
+		size_t body = bytes & ~(CacheLine - 1);
+		streamLines(d, s, body, cpuLevel());
+
+		memcpy(d + body, s + body, bytes - body);
+	}
+
+	inline void copy(void* dst, const void* src, size_t bytes)
+	{
+		if (bytes < StreamingThreshold)
+		{
+			memcpy(dst, src, bytes);
+		}
+		else
+		{
+			streamCopy(dst, src, bytes);
+		}
+	}
+
+	// Typed version : the size check is done on a compile time multiple of
+	// sizeof(T), and when T is a whole number of cache lines with matching
+	// alignment, the head and tail handling goes away entirely.
+	template <typename T>
+	void copyBuckets(T* dst, const T* src, size_t count)
+	{
+		size_t bytes = count * sizeof(T);
+
+		if constexpr (sizeof(T) >= StreamingThreshold)
+		{
+			streamCopy(dst, src, bytes);
+		}
+		else if constexpr (sizeof(T) % CacheLine == 0 && alignof(T) % CacheLine == 0)
+		{
+			if (bytes < StreamingThreshold)
+			{
+				memcpy(dst, src, bytes);
+			}
+			else
+			{
+				streamLines(reinterpret_cast<char*>(dst), reinterpret_cast<const char*>(src), bytes, cpuLevel());
+			}
+		}
+		else
+		{
+			copy(dst, src, bytes);
+		}
+	}
+};
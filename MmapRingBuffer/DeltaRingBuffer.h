@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "RingBuffer.h"
+
+// Compressed ring of 64 bits integers, for streams of ids, timestamps,
+// counters... where consecutive values are close to each other.
+//
+// Values are pushed into a staging block of up to BlockSize values, which gets
+// encoded in a RingBuffer<uint8_t> when full (or on flush()). A block is :
+//
+//   uint16 size in bytes | uint8 count | uint64 first value | control bytes | deltas
+//
+// Each delta to the previous value is zigzag encoded (small negative deltas stay
+// small) and stored on 1, 2, 4 or 8 bytes, given by a 2 bits code in the control
+// bytes, 4 codes per byte, stream-vbyte style : counters moving by less than 128
+// take ~1 byte a value instead of 8.
+//
+// Decoding has no branch per value : an unaligned 8 bytes load, a mask and a
+// table lookup for the length. The loads read up to 7 bytes past the block ; the
+// mirror makes that fine even at the end of the buffer. Blocks are contiguous
+// too, whatever their position, the mirror again.
+//
+// Like RingBuffer, it never blocks the writer : when there's no room for a
+// block, whole blocks are evicted from the read side.
+class DeltaRingBuffer {
+public:
+	static constexpr size_t BlockSize = 128;
+	static constexpr size_t HeaderBytes = 2 + 1 + 8;
+	static constexpr size_t MaxBlockBytes = HeaderBytes + (BlockSize - 1 + 3) / 4 + (BlockSize - 1) * 8;
+
+	// nbBytes of compressed storage, at least MaxBlockBytes + 16.
+	DeltaRingBuffer(size_t nbBytes);
+
+	DeltaRingBuffer(const DeltaRingBuffer&) = delete;
+	DeltaRingBuffer& operator=(const DeltaRingBuffer&) = delete;
+
+	void push(uint64_t value);
+
+	// Encodes the staged values right away, even if it's not a full block.
+	void flush();
+
+	// Values that can be read, staged values not included.
+	size_t availableValues() const { return _values; }
+	size_t stagedValues() const { return _stagedCount; }
+
+	// Values dropped to make room, since creation.
+	uint64_t evictedValues() const { return _evicted; }
+
+	// Bytes used by the encoded blocks.
+	size_t compressedBytes() const { return _ring.availableForRead(); }
+
+	// Decodes the oldest block in dst, which must have room for BlockSize values.
+	// Returns how many values were decoded, 0 when there's nothing to read.
+	size_t readBlock(uint64_t* dst);
+
+private:
+	static uint64_t zigzag(uint64_t delta) { return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63); }
+	static uint64_t unzigzag(uint64_t z) { return (z >> 1) ^ (0 - (z & 1)); }
+
+	// 0, 1, 2, 3 for 1, 2, 4, 8 bytes.
+	static unsigned codeOf(uint64_t z) { return (z > 0xFF) + (z > 0xFFFF) + (z > 0xFFFFFFFF); }
+
+	// Decodes the block at src in dst, returns its count.
+	static size_t decode(const uint8_t* src, uint64_t* dst);
+
+	void encode();
+	void evictBlock();
+
+private:
+	static constexpr uint8_t Length[4] = { 1, 2, 4, 8 };
+	static constexpr uint64_t Mask[4] = { 0xFF, 0xFFFF, 0xFFFFFFFF, ~0ull };
+
+	RingBuffer<uint8_t> _ring;
+
+	uint64_t _staged[BlockSize];
+	size_t _stagedCount{ 0 };
+
+	size_t _values{ 0 };
+	uint64_t _evicted{ 0 };
+};
+
+inline DeltaRingBuffer::DeltaRingBuffer(size_t nbBytes)
+	: _ring{ nbBytes }
+{
+	if (nbBytes < MaxBlockBytes + 16)
+	{
+		throw std::runtime_error{ "DeltaRingBuffer needs room for at least one full block." };
+	}
+}
+
+inline void DeltaRingBuffer::push(uint64_t value)
+{
+	_staged[_stagedCount++] = value;
+
+	if (_stagedCount == BlockSize)
+	{
+		encode();
+	}
+}
+
+inline void DeltaRingBuffer::flush()
+{
+	if (_stagedCount != 0)
+	{
+		encode();
+	}
+}
+
+inline void DeltaRingBuffer::encode()
+{
+	size_t count = _stagedCount;
+	size_t controlBytes = (count - 1 + 3) / 4;
+
+	size_t size = HeaderBytes + controlBytes;
+	for (size_t i = 1; i < count; i++)
+	{
+		size += Length[codeOf(zigzag(_staged[i] - _staged[i - 1]))];
+	}
+
+	// The 8 bytes stores spill up to 7 bytes past the block.
+	while (_ring.availableForWrite() < size + 8)
+	{
+		evictBlock();
+	}
+
+	uint8_t* out = _ring.writeBuffer();
+	uint16_t size16 = static_cast<uint16_t>(size);
+	uint8_t count8 = static_cast<uint8_t>(count);
+	memcpy(out, &size16, sizeof(size16));
+	memcpy(out + 2, &count8, sizeof(count8));
+	memcpy(out + 3, &_staged[0], sizeof(uint64_t));
+
+	uint8_t* control = out + HeaderBytes;
+	uint8_t* data = control + controlBytes;
+	memset(control, 0, controlBytes);
+
+	for (size_t i = 1; i < count; i++)
+	{
+		uint64_t z = zigzag(_staged[i] - _staged[i - 1]);
+		unsigned code = codeOf(z);
+
+		control[(i - 1) >> 2] |= static_cast<uint8_t>(code << (((i - 1) & 3) * 2));
+		memcpy(data, &z, sizeof(z));
+		data += Length[code];
+	}
+
+	_ring.advanceWriteHead(size);
+	_values += count;
+	_stagedCount = 0;
+}
+
+inline void DeltaRingBuffer::evictBlock()
+{
+	const uint8_t* block = _ring.readBuffer();
+
+	uint16_t size;
+	memcpy(&size, block, sizeof(size));
+	size_t count = block[2];
+
+	_ring.advanceReadHead(size);
+	_values -= count;
+	_evicted += count;
+}
+
+inline size_t DeltaRingBuffer::readBlock(uint64_t* dst)
+{
+	if (!_ring.hasData())
+	{
+		return 0;
+	}
+
+	const uint8_t* block = _ring.readBuffer();
+
+	uint16_t size;
+	memcpy(&size, block, sizeof(size));
+	size_t count = decode(block, dst);
+
+	_ring.advanceReadHead(size);
+	_values -= count;
+
+	return count;
+}
+
+inline size_t DeltaRingBuffer::decode(const uint8_t* src, uint64_t* dst)
+{
+	size_t count = src[2];
+	size_t controlBytes = (count - 1 + 3) / 4;
+
+	uint64_t value;
+	memcpy(&value, src + 3, sizeof(value));
+	dst[0] = value;
+
+	const uint8_t* control = src + HeaderBytes;
+	const uint8_t* data = control + controlBytes;
+
+	for (size_t i = 1; i < count; i++)
+	{
+		unsigned code = (control[(i - 1) >> 2] >> (((i - 1) & 3) * 2)) & 3;
+
+		uint64_t z;
+		memcpy(&z, data, sizeof(z));
+		data += Length[code];
+
+		value += unzigzag(z & Mask[code]);
+		dst[i] = value;
+	}
+
+	return count;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// Log-linear histogram in the spirit of HdrHistogram.
+//
+// Values below 2^SubBucketBits get a bucket each. Above that, every power of
+// two range is split in 2^SubBucketBits linear sub buckets, so the reported
+// values are within ~3% of the recorded ones over the whole uint64 range with
+// a fixed, small, footprint (1920 counters).
+//
+// record() is a couple of relaxed atomic adds : lock free, fine to call from
+// any thread. Queries walk the counters and are meant for reporting, not for
+// hot paths.
+class LatencyHistogram {
+public:
+	static constexpr unsigned SubBucketBits = 5;
+	static constexpr uint64_t SubBucketCount = 1ull << SubBucketBits;
+	static constexpr size_t BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+	void record(uint64_t value, uint64_t count = 1)
+	{
+		_counts[indexOf(value)].fetch_add(count, std::memory_order_relaxed);
+		_total.fetch_add(count, std::memory_order_relaxed);
+
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+	}
+
+	uint64_t count() const { return _total.load(std::memory_order_relaxed); }
+	uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+	// Smallest value v such that at least p% of the recorded values are <= v,
+	// give or take the bucket precision. p in [0, 100]. 0 if nothing recorded.
+	uint64_t percentile(double p) const;
+
+	void reset();
+
+private:
+	static size_t indexOf(uint64_t value)
+	{
+		if (value < SubBucketCount)
+		{
+			return static_cast<size_t>(value);
+		}
+
+		// msb is >= SubBucketBits here. Keep the SubBucketBits bits below it.
+		unsigned msb = static_cast<unsigned>(std::bit_width(value)) - 1;
+		unsigned shift = msb - SubBucketBits;
+		uint64_t sub = (value >> shift) - SubBucketCount;
+
+		return static_cast<size_t>((shift + 1) * SubBucketCount + sub);
+	}
+
+	// Highest value that lands in bucket index.
+	static uint64_t highestOf(size_t index)
+	{
+		if (index < SubBucketCount)
+		{
+			return index;
+		}
+
+		unsigned shift = static_cast<unsigned>(index / SubBucketCount) - 1;
+		uint64_t sub = index % SubBucketCount;
+		uint64_t lowest = (SubBucketCount + sub) << shift;
+
+		return lowest + ((1ull << shift) - 1);
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, BucketCount> _counts{};
+	std::atomic<uint64_t> _total{ 0 };
+	std::atomic<uint64_t> _max{ 0 };
+};
+
+inline uint64_t LatencyHistogram::percentile(double p) const
+{
+	uint64_t total = count();
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	p = p < 0.0 ? 0.0 : (p > 100.0 ? 100.0 : p);
+
+	uint64_t target = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+	target = target == 0 ? 1 : target;
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BucketCount; i++)
+	{
+		seen += _counts[i].load(std::memory_order_relaxed);
+		if (seen >= target)
+		{
+			uint64_t value = highestOf(i);
+			return value < max() ? value : max();
+		}
+	}
+
+	return max();
+}
+
+inline void LatencyHistogram::reset()
+{
+	for (std::atomic<uint64_t>& c : _counts)
+	{
+		c.store(0, std::memory_order_relaxed);
+	}
+
+	_total.store(0, std::memory_order_relaxed);
+	_max.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <windows.h>
+#include <Psapi.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "System.h"
+
+// Process wide bookkeeping of the live VMemMirrorBuffers.
+//
+// Every mirror buffer commits a paging file section of its size (that's what
+// counts against the commit limit) and reserves twice that in address space.
+// Nothing else keeps track of them : with the registry enabled, each allocate()
+// registers the buffer with a tag and the place it was created from, and a
+// budget can be set so allocations past it throw instead of running the box out
+// of commit. Shared views (VMemMirrorBuffer::share, ring snapshots) are entries
+// of their own : they reserve their own address space and keep the section
+// committed even once the original is gone.
+//
+//   MirrorRegistry::enable();
+//   MirrorRegistry::instance().setBudget(512 << 20);
+//   RingBuffer<Tick> ticks{ 1 << 20, RingSizing::Pages, "ticks" };
+//   MirrorRegistry::instance().report(std::cout);
+//
+// Off by default, and buffers allocated while it's off are never registered.
+// Thread safe.
+class MirrorRegistry {
+public:
+	struct Entry {
+		const void* base;
+		// Section size. The buffer reserves twice that in address space.
+		size_t size;
+		std::string tag;
+		std::source_location site;
+	};
+
+	static MirrorRegistry& instance()
+	{
+		static MirrorRegistry registry;
+		return registry;
+	}
+
+	static void enable(bool on = true) { enabledFlag().store(on, std::memory_order_relaxed); }
+	static bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+
+	// Max total section bytes, 0 for no limit. Only checked for new buffers,
+	// before their section is created.
+	void setBudget(size_t bytes);
+	size_t budget() const;
+
+	size_t count() const;
+	// Includes buffers being allocated right now.
+	size_t totalBytes() const;
+	size_t totalAddressSpace() const { return 2 * totalBytes(); }
+
+	// Bytes of the buffers currently in the process working set. Walks the pages
+	// of every buffer : for reporting, not for hot paths.
+	size_t totalResidentBytes() const;
+
+	std::vector<Entry> entries() const;
+
+	// One line per buffer, then the totals.
+	void report(std::ostream& out) const;
+
+	// Resident bytes of a mirror buffer at base, size bytes per view. A page
+	// counts once even if it's in the working set through both views.
+	static size_t residentBytes(const void* base, size_t size);
+
+	// Used by VMemMirrorBuffer. reserve counts size bytes against the budget
+	// and throws if that exceeds it, before anything is created. Then either
+	// add registers the buffer the bytes were for, or unreserve gives them back.
+	void reserve(size_t size);
+	void unreserve(size_t size);
+	void add(const void* base, size_t size, const char* tag, const std::source_location& site);
+	void remove(const void* base);
+
+private:
+	MirrorRegistry() {}
+
+	static std::atomic<bool>& enabledFlag()
+	{
+		static std::atomic<bool> flag{ false };
+		return flag;
+	}
+
+private:
+	mutable std::mutex _mutex;
+	std::map<const void*, Entry> _entries;
+	size_t _totalBytes{ 0 };
+	size_t _budget{ 0 };
+};
+
+inline void MirrorRegistry::setBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_budget = bytes;
+}
+
+inline size_t MirrorRegistry::budget() const
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	return _budget;
+}
+
+inline size_t MirrorRegistry::count() const
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	return _entries.size();
+}
+
+inline size_t MirrorRegistry::totalBytes() const
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	return _totalBytes;
+}
+
+inline std::vector<MirrorRegistry::Entry> MirrorRegistry::entries() const
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+
+	std::vector<Entry> entries;
+	entries.reserve(_entries.size());
+	for (const auto& [base, entry] : _entries)
+	{
+		entries.push_back(entry);
+	}
+
+	return entries;
+}
+
+inline size_t MirrorRegistry::totalResidentBytes() const
+{
+	size_t total = 0;
+
+	// Walks a copy : no need to hold the lock while querying the system.
+	for (const Entry& entry : entries())
+	{
+		total += residentBytes(entry.base, entry.size);
+	}
+
+	return total;
+}
+
+inline void MirrorRegistry::report(std::ostream& out) const
+{
+	size_t resident = 0;
+
+	for (const Entry& entry : entries())
+	{
+		size_t r = residentBytes(entry.base, entry.size);
+		resident += r;
+
+		out << (entry.tag.empty() ? "<untagged>" : entry.tag) << ": "
+			<< entry.size << " bytes, " << r << " resident, "
+			<< entry.site.file_name() << ":" << entry.site.line()
+			<< std::endl;
+	}
+
+	out << count() << " mirror buffers, " << totalBytes() << " bytes, "
+		<< resident << " resident, budget " << budget()
+		<< std::endl;
+}
+
+inline size_t MirrorRegistry::residentBytes(const void* base, size_t size)
+{
+	constexpr size_t Batch = 512;
+
+	size_t pageSize = System::getPageSize();
+	size_t pages = size / pageSize;
+	const char* view1 = static_cast<const char*>(base);
+	const char* view2 = view1 + size;
+
+	PSAPI_WORKING_SET_EX_INFORMATION info[2 * Batch];
+	size_t resident = 0;
+
+	for (size_t first = 0; first < pages; first += Batch)
+	{
+		size_t n = (pages - first < Batch) ? pages - first : Batch;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			info[2 * i].VirtualAddress = const_cast<char*>(view1 + (first + i) * pageSize);
+			info[2 * i + 1].VirtualAddress = const_cast<char*>(view2 + (first + i) * pageSize);
+		}
+
+		if (!QueryWorkingSetEx(GetCurrentProcess(), info, static_cast<DWORD>(2 * n * sizeof(info[0]))))
+		{
+			throw std::runtime_error{ "QueryWorkingSetEx failed" };
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			resident += (info[2 * i].VirtualAttributes.Valid || info[2 * i + 1].VirtualAttributes.Valid) ? pageSize : 0;
+		}
+	}
+
+	return resident;
+}
+
+inline void MirrorRegistry::reserve(size_t size)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+
+	if (_budget != 0 && _totalBytes + size > _budget)
+	{
+		throw std::runtime_error{ "mirror buffer budget exceeded" };
+	}
+
+	_totalBytes += size;
+}
+
+inline void MirrorRegistry::unreserve(size_t size)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_totalBytes -= size;
+}
+
+inline void MirrorRegistry::add(const void* base, size_t size, const char* tag, const std::source_location& site)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+	_entries[base] = Entry{ base, size, tag ? tag : "", site };
+}
+
+inline void MirrorRegistry::remove(const void* base)
+{
+	std::lock_guard<std::mutex> lock{ _mutex };
+
+	auto it = _entries.find(base);
+	if (it != _entries.end())
+	{
+		_totalBytes -= it->second.size;
+		_entries.erase(it);
+	}
+}
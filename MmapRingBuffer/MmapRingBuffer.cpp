@@ -1,9 +1,29 @@
 #include <windows.h>
 #include <iostream>
+#include <filesystem>
+#include <sstream>
 
 #include "microtest.h"
 #include "VMemMirrorBuffer.h"
 #include "RingBuffer.h"
+#include "AsyncRingBuffer.h"
+#include "TimeIndexedRing.h"
+#include "SlidingWindow.h"
+#include "LatencyHistogram.h"
+#include "ColumnRingBuffer.h"
+#include "ParallelDrain.h"
+#include "CopyKernels.h"
+#include "BroadcastRingBuffer.h"
+#include "PerfCounters.h"
+#include "Pipeline.h"
+#include "RingCapture.h"
+#include "RingLogger.h"
+#include "MirrorRegistry.h"
+#include "DeltaRingBuffer.h"
+#include "RingFlusher.h"
+#include "PriorityRingSet.h"
+#include "BitStream.h"
+#include "SlotPool.h"
 
 #include <sysinfoapi.h>
 
@@ -12,6 +32,11 @@ struct BUFFED_CHAR {
 	char buff[1023];
 };
 
+struct SAMPLE {
+	int64_t timestamp;
+	int64_t value;
+};
+
 TEST(PRINT_SYSTEM_INFO) {
 	SYSTEM_INFO sys{};
 	GetSystemInfo(&sys);
@@ -445,5 +470,1494 @@ TEST(TEST_BATCH_WRITE) {
 	ASSERT_EQ(cr.v, 'g');
 }
 
+RingTask produceChars(AsyncRingBuffer<BUFFED_CHAR>& ring, const char* text) {
+	for (const char* c = text; *c != 0; c++) {
+		std::span<BUFFED_CHAR> space = co_await ring.writable(1);
+		space[0].v = *c;
+		ring.advanceWriteHead(1);
+	}
+}
+
+RingTask consumeChars(AsyncRingBuffer<BUFFED_CHAR>& ring, size_t count, std::string& out) {
+	while (out.size() < count) {
+		std::span<BUFFED_CHAR> data = co_await ring.readable(1);
+		for (BUFFED_CHAR& c : data) {
+			out.push_back(c.v);
+		}
+		ring.advanceReadHead(data.size());
+	}
+}
+
+TEST(TEST_ASYNC_RING_PRODUCER_CONSUMER) {
+	RingExecutor executor;
+	AsyncRingBuffer<BUFFED_CHAR> b{ 4, executor };
+	std::string out;
+
+	// Consumer parks right away, producer fills the ring then parks on the 4th char.
+	consumeChars(b, 10, out);
+	produceChars(b, "abcdefghij");
+	ASSERT_TRUE(b.ring().isFull());
+	ASSERT_TRUE(executor.hasWork());
+
+	executor.run();
+
+	ASSERT_STREQ("abcdefghij", out);
+	ASSERT_FALSE(b.ring().hasData());
+	ASSERT_FALSE(executor.hasWork());
+
+	// more than the ring can ever hold : would park forever
+	int threw = 0;
+	try {
+		b.readable(b.ring().availableBuckets() + 1);
+	}
+	catch (std::runtime_error&) {
+		threw++;
+	}
+	try {
+		b.writable(b.ring().availableBuckets() + 1);
+	}
+	catch (std::runtime_error&) {
+		threw++;
+	}
+	ASSERT_EQ(2, threw);
+
+	// a second reader while one is parked : the error reaches the caller, the
+	// first reader carries on
+	std::string first;
+	std::string second;
+	consumeChars(b, 2, first);
+	bool secondThrew = false;
+	try {
+		consumeChars(b, 2, second);
+	}
+	catch (std::runtime_error&) {
+		secondThrew = true;
+	}
+	ASSERT_TRUE(secondThrew);
+
+	produceChars(b, "xy");
+	executor.run();
+	ASSERT_STREQ("xy", first);
+	ASSERT_TRUE(second.empty());
+}
+
+TEST(TEST_RING_NOTIFICATIONS) {
+	RingBuffer<BUFFED_CHAR> b{ 4 };
+	BUFFED_CHAR cw;
+	cw.v = 'a';
+
+	ASSERT_TRUE(b.readEvent() == nullptr);
+	ASSERT_TRUE(b.writeEvent() == nullptr);
+
+	b.enableNotifications(2, 3);
+	ASSERT_EQ(WAIT_TIMEOUT, WaitForSingleObject(b.readEvent(), 0));
+	ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(b.writeEvent(), 0));
+
+	b.write(cw);
+	ASSERT_EQ(WAIT_TIMEOUT, WaitForSingleObject(b.readEvent(), 0));
+	ASSERT_EQ(WAIT_TIMEOUT, WaitForSingleObject(b.writeEvent(), 0));
+
+	b.write(cw);
+	ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(b.readEvent(), 0));
+
+	b.read();
+	ASSERT_EQ(WAIT_TIMEOUT, WaitForSingleObject(b.readEvent(), 0));
+
+	b.writeBuffer()[0] = cw;
+	b.advanceWriteHead(1);
+	ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(b.readEvent(), 0));
+
+	b.reset();
+	ASSERT_EQ(WAIT_TIMEOUT, WaitForSingleObject(b.readEvent(), 0));
+	ASSERT_EQ(WAIT_OBJECT_0, WaitForSingleObject(b.writeEvent(), 0));
+
+	b.disableNotifications();
+	ASSERT_TRUE(b.readEvent() == nullptr);
+}
+
+TEST(TEST_TIME_INDEXED_RING) {
+	// 256 * 16 bytes = 1 page, 255 usable buckets
+	TimeIndexedRing<SAMPLE> b{ 256 };
+
+	ASSERT_EQ(0, b.range(0, 100).size());
+
+	for (int64_t i = 0; i < 300; i++) {
+		b.push(SAMPLE{ i * 10, i });
+	}
+
+	// oldest 45 samples were overwritten
+	ASSERT_EQ(255, b.size());
+	ASSERT_EQ(450, b.samples().front().timestamp);
+
+	std::span<const SAMPLE> r = b.range(1000, 1500);
+	ASSERT_EQ(50, r.size());
+	ASSERT_EQ(1000, r.front().timestamp);
+	ASSERT_EQ(1490, r.back().timestamp);
+
+	r = b.range(1005, 1015);
+	ASSERT_EQ(1, r.size());
+	ASSERT_EQ(1010, r.front().timestamp);
+
+	ASSERT_EQ(0, b.range(0, 450).size());
+	ASSERT_EQ(0, b.range(3000, 4000).size());
+	ASSERT_EQ(255, b.range(0, 4000).size());
+
+	size_t evicted = b.evictOlderThan(2000);
+	ASSERT_EQ(155, evicted);
+	ASSERT_EQ(100, b.size());
+	ASSERT_EQ(2000, b.samples().front().timestamp);
+	evicted = b.evictOlderThan(2000);
+	ASSERT_EQ(0, evicted);
+
+	bool threw = false;
+	try {
+		b.push(SAMPLE{ 0, 0 });
+	}
+	catch (std::runtime_error&) {
+		threw = true;
+	}
+	ASSERT_TRUE(threw);
+}
+
+TEST(TEST_SLIDING_WINDOW) {
+	SlidingWindow<int64_t> w{ 100, 512 };
+
+	for (int64_t i = 1; i <= 1000; i++) {
+		w.push(i);
+	}
+
+	ASSERT_EQ(100, w.size());
+	ASSERT_EQ(901, w.window().front());
+	ASSERT_EQ(1000, w.window().back());
+	ASSERT_EQ(95050, w.sum());
+	ASSERT_TRUE(w.mean() == 950.5);
+	ASSERT_TRUE((w.minMax() == std::pair<int64_t, int64_t>{ 901, 1000 }));
+
+	int64_t* batch = w.writeBuffer();
+	for (int64_t i = 0; i < 50; i++) {
+		batch[i] = 2000 + i;
+	}
+	w.commit(50);
+
+	ASSERT_EQ(100, w.size());
+	ASSERT_EQ(951, w.window().front());
+	ASSERT_EQ(2049, w.window().back());
+	ASSERT_EQ(150000, w.sum());
+	ASSERT_EQ(150000, WindowKernels::sum(w.window().data(), w.size()));
+
+	batch = w.writeBuffer();
+	for (int64_t i = 0; i < 200; i++) {
+		batch[i] = i;
+	}
+	w.commit(200);
+	ASSERT_EQ(100, w.window().front());
+	ASSERT_EQ(14950, w.sum());
+}
+
+TEST(TEST_WINDOW_KERNELS) {
+	SlidingWindow<float> w{ 8, 1024 };
+	for (int i = 1; i <= 20; i++) {
+		w.push(static_cast<float>(i));
+	}
+
+	ASSERT_TRUE(w.sum() == 132.f);
+	ASSERT_TRUE(WindowKernels::sum(w.window().data(), w.size()) == 132.f);
+	ASSERT_TRUE((w.minMax() == std::make_pair(13.f, 20.f)));
+
+	float taps[2] = { 0.5f, 0.5f };
+	float out[8];
+	size_t nbOut = WindowKernels::fir(w.window().data(), w.size(), taps, 2, out);
+	ASSERT_EQ(7, nbOut);
+	ASSERT_TRUE(out[0] == 13.5f);
+	ASSERT_TRUE(out[6] == 19.5f);
+
+	float wide[37];
+	for (int i = 0; i < 37; i++) {
+		wide[i] = static_cast<float>((i * 7) % 37) - 10.f;
+	}
+	ASSERT_TRUE((WindowKernels::minMax(wide, 37) == std::make_pair(-10.f, 26.f)));
+	ASSERT_TRUE(WindowKernels::sum(wide, 37) == 296.f);
+}
+
+TEST(TEST_RING_SNAPSHOT) {
+	RingBuffer<BUFFED_CHAR> b{ 8 };
+	BUFFED_CHAR cw;
+
+	for (char c : std::string{ "abcd" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	b.read();
+
+	RingSnapshot<BUFFED_CHAR> snap = b.snapshot();
+	ASSERT_EQ(3, snap.size());
+	ASSERT_EQ(0, snap.lostCount());
+	ASSERT_EQ('b', snap.intact()[0].v);
+	ASSERT_EQ('d', snap.intact()[2].v);
+
+	// 5 free buckets : these don't touch the snapshot, even the one that
+	// pushes the live read head.
+	for (char c : std::string{ "efghi" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	ASSERT_EQ(0, snap.lostCount());
+	ASSERT_EQ(3, snap.intact().size());
+	ASSERT_EQ('b', snap.intact()[0].v);
+
+	cw.v = 'j';
+	b.write(cw);
+	ASSERT_EQ(1, snap.lostCount());
+	ASSERT_EQ(2, snap.intact().size());
+	ASSERT_EQ('c', snap.intact()[0].v);
+	ASSERT_EQ('d', snap.intact()[1].v);
+
+	b.advanceWriteHead(5);
+	ASSERT_EQ(3, snap.lostCount());
+	ASSERT_EQ(0, snap.intact().size());
+
+	// copies are still full, independent copies
+	RingBuffer<BUFFED_CHAR> copy{ b };
+	ASSERT_EQ(b.availableForRead(), copy.availableForRead());
+	ASSERT_EQ(b.readBuffer()[0].v, copy.readBuffer()[0].v);
+	cw.v = 'z';
+	copy.write(cw);
+	ASSERT_EQ('z', copy.readBuffer()[copy.availableForRead() - 1].v);
+	ASSERT_NEQ('z', b.readBuffer()[b.availableForRead() - 1].v);
+}
+
+TEST(TEST_RING_SNAPSHOT_CONCURRENT) {
+	RingBuffer<int64_t> b{ 4096 };
+	for (int64_t i = 0; i < 3000; i++) {
+		b.write(i);
+	}
+	b.advanceReadHead(1000);
+
+	RingSnapshot<int64_t> snap = b.snapshot();
+	ASSERT_EQ(2000, snap.size());
+
+	// the ring moves and keeps going on another thread, the snapshot follows
+	RingBuffer<int64_t> moved{ std::move(b) };
+	std::thread producer{ [&] {
+		std::vector<int64_t> batch(100);
+		for (int64_t i = 3000; i < 1000000; i += 100) {
+			for (int64_t j = 0; j < 100; j++) {
+				batch[j] = -1;
+			}
+			moved.writeBatch(batch.data(), batch.size());
+		}
+	} };
+
+	// whatever is still intact once copied must be the original data
+	std::vector<int64_t> copy(2000);
+	bool ok = true;
+	while (snap.lostCount() < snap.size()) {
+		std::span<const int64_t> intact = snap.intact();
+		size_t lostBefore = snap.size() - intact.size();
+		std::copy(intact.begin(), intact.end(), copy.begin());
+
+		size_t lostAfter = snap.lostCount();
+		for (size_t i = lostAfter - lostBefore; i < intact.size(); i++) {
+			ok = ok && copy[i] == static_cast<int64_t>(1000 + lostBefore + i);
+		}
+	}
+	producer.join();
+
+	ASSERT_TRUE(ok);
+	ASSERT_EQ(0, snap.intact().size());
+}
+
+TEST(TEST_LATENCY_HISTOGRAM) {
+	LatencyHistogram h;
+	ASSERT_EQ(0, h.percentile(50));
+
+	for (uint64_t i = 1; i <= 1000; i++) {
+		h.record(i);
+	}
+
+	ASSERT_EQ(1000, h.count());
+	ASSERT_EQ(1000, h.max());
+	ASSERT_EQ(1, h.percentile(0));
+	ASSERT_EQ(1000, h.percentile(100));
+
+	// 32 sub buckets per power of 2 : within ~3%
+	uint64_t p50 = h.percentile(50);
+	ASSERT_TRUE(p50 >= 500 && p50 <= 516);
+	uint64_t p99 = h.percentile(99);
+	ASSERT_TRUE(p99 >= 990 && p99 <= 1000);
+
+	// small values are exact
+	h.reset();
+	h.record(7, 10);
+	ASSERT_EQ(10, h.count());
+	ASSERT_EQ(7, h.percentile(50));
+
+	h.record(1ull << 40);
+	ASSERT_EQ(1ull << 40, h.percentile(100));
+}
+
+// Run the Trace configuration for this one.
+#ifdef RINGBUFFER_TRACE_LATENCY
+TEST(TEST_RING_LATENCY_TRACING) {
+	RingBuffer<BUFFED_CHAR> b{ 4 };
+	BUFFED_CHAR cw;
+	cw.v = 'a';
+
+	b.write(cw);
+	b.read();
+	ASSERT_EQ(1, b.latency().count());
+
+	b.advanceWriteHead(3);
+	b.advanceReadHead(2);
+	b.read();
+	ASSERT_EQ(4, b.latency().count());
+
+	b.resetLatency();
+	ASSERT_EQ(0, b.latency().count());
+}
+#endif
+
+TEST(TEST_RELEASE_FREE_MEMORY) {
+	// 2 pages, 4 buckets per page
+	RingBuffer<BUFFED_CHAR> b{ 8 };
+	BUFFED_CHAR cw;
+
+	size_t released = b.releaseFreeMemory();
+	ASSERT_EQ(2 * System::getPageSize(), released);
+
+	for (char c : std::string{ "abc" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	b.read();
+
+	// Free region is buckets [3, 8) + [0, 1) : only the second page is whole.
+	released = b.releaseFreeMemory();
+	ASSERT_EQ(System::getPageSize(), released);
+
+	BUFFED_CHAR cr;
+	cr = b.read();
+	ASSERT_EQ('b', cr.v);
+	cr = b.read();
+	ASSERT_EQ('c', cr.v);
+
+	// Still usable, across the wrap too.
+	for (char c : std::string{ "defghij" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	for (char c : std::string{ "defghij" }) {
+		cr = b.read();
+		ASSERT_EQ(c, cr.v);
+	}
+
+	b.releaseFreeMemory();
+	uint64_t total = b.totalReleasedBytes();
+	b.setAutoRelease(4 * sizeof(BUFFED_CHAR));
+
+	// 3 buckets written since last release : not enough.
+	for (char c : std::string{ "klm" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	b.advanceReadHead(3);
+	ASSERT_EQ(total, b.totalReleasedBytes());
+
+	cw.v = 'n';
+	b.write(cw);
+	b.read();
+	ASSERT_TRUE(b.totalReleasedBytes() > total);
+
+	// A live snapshot reads what's now the free region : nothing is discarded
+	// under it, even when the ring drains.
+	for (char c : std::string{ "opqrstu" }) {
+		cw.v = c;
+		b.write(cw);
+	}
+	total = b.totalReleasedBytes();
+	{
+		RingSnapshot<BUFFED_CHAR> snap = b.snapshot();
+		while (b.hasData()) {
+			b.read();
+		}
+		ASSERT_EQ(0, b.releaseFreeMemory());
+		ASSERT_EQ(total, b.totalReleasedBytes());
+		ASSERT_EQ(0, snap.lostCount());
+		ASSERT_EQ('o', snap.intact()[0].v);
+		ASSERT_EQ('u', snap.intact()[6].v);
+
+		// moved snapshots still count, once
+		RingSnapshot<BUFFED_CHAR> other = std::move(snap);
+		ASSERT_EQ(0, b.releaseFreeMemory());
+		ASSERT_EQ('u', other.intact()[6].v);
+	}
+	ASSERT_TRUE(b.releaseFreeMemory() > 0);
+}
+
+TEST(TEST_COLUMN_RING_BUFFER) {
+	// price, size, timestamp, flags
+	ColumnRingBuffer<double, uint32_t, int64_t, uint8_t> b{ 4096 };
+
+	ASSERT_FALSE(b.hasData());
+	ASSERT_EQ(4095, b.availableForWrite());
+
+	for (int64_t i = 0; i < 5000; i++) {
+		b.write(static_cast<double>(i), static_cast<uint32_t>(i % 100), i, static_cast<uint8_t>(i & 1));
+	}
+
+	// oldest 905 rows overwritten, heads wrapped
+	ASSERT_TRUE(b.isFull());
+	ASSERT_EQ(4095, b.availableForRead());
+
+	auto [prices, sizes, times, flags] = b.readSpans();
+	ASSERT_EQ(4095, prices.size());
+	ASSERT_EQ(4095, flags.size());
+	ASSERT_TRUE(prices.front() == 905.0);
+	ASSERT_TRUE(prices.back() == 4999.0);
+	ASSERT_EQ(4999, times.back());
+	ASSERT_EQ(99, sizes.back());
+	ASSERT_EQ(1, flags.back());
+
+	// contiguous across the wrap
+	for (size_t i = 0; i < times.size(); i++) {
+		ASSERT_EQ(905 + static_cast<int64_t>(i), times[i]);
+	}
+
+	b.advanceReadHead(4000);
+	ASSERT_EQ(95, b.column<0>().size());
+
+	auto [wPrices, wSizes, wTimes, wFlags] = b.writeBuffers();
+	for (size_t i = 0; i < 200; i++) {
+		wPrices[i] = 1.5;
+		wSizes[i] = 2;
+		wTimes[i] = 6000 + i;
+		wFlags[i] = 0;
+	}
+	b.advanceWriteHead(200);
+
+	ASSERT_EQ(295, b.availableForRead());
+	ASSERT_EQ(6199, b.column<2>().back());
+	ASSERT_TRUE(b.column<0>().back() == 1.5);
+}
+
+TEST(TEST_ARBITRARY_CAPACITY) {
+	RingBuffer<int> b{ 1000 };
+
+	ASSERT_EQ(999, b.availableBuckets());
+	ASSERT_EQ(1024, b.bucketCount());
+	ASSERT_EQ(999, b.availableForWrite());
+
+	for (int i = 0; i < 2500; i++) {
+		b.write(i);
+	}
+
+	// Never holds more than asked, even though there are 1024 buckets.
+	ASSERT_TRUE(b.isFull());
+	ASSERT_EQ(999, b.availableForRead());
+	ASSERT_EQ(0, b.availableForWrite());
+	ASSERT_EQ(1501, b.readBuffer()[0]);
+	ASSERT_EQ(2499, b.readBuffer()[998]);
+
+	b.advanceReadHead(500);
+	b.advanceWriteHead(700);
+	ASSERT_EQ(999, b.availableForRead());
+	int oldest = b.read();
+	ASSERT_EQ(2201, oldest);
+
+	// 24 bytes : 512 buckets to fill 3 pages
+	struct TRIPLE { int64_t a, b, c; };
+	RingBuffer<TRIPLE> t{ 100 };
+	ASSERT_EQ(99, t.availableBuckets());
+	ASSERT_EQ(0, (t.bucketCount() * sizeof(TRIPLE)) % System::getPageSize());
+
+	for (int64_t i = 0; i < 1000; i++) {
+		t.write(TRIPLE{ i, i, i });
+	}
+	ASSERT_EQ(99, t.availableForRead());
+	ASSERT_EQ(901, t.readBuffer()[0].a);
+	ASSERT_EQ(999, t.readBuffer()[98].c);
+
+	RingBuffer<TRIPLE> p{ 100, RingSizing::PowerOfTwo };
+	ASSERT_EQ(99, p.availableBuckets());
+	ASSERT_TRUE(std::has_single_bit(p.bucketCount()));
+	ASSERT_EQ(0, (p.bucketCount() * sizeof(TRIPLE)) % System::getPageSize());
+
+	ColumnRingBuffer<int64_t, uint8_t> c{ 100 };
+	ASSERT_EQ(99, c.availableBuckets());
+	ASSERT_EQ(System::getPageSize(), c.bucketCount());
+}
+
+TEST(TEST_PARALLEL_CONSUME) {
+	WorkerPool pool{ 3 };
+	RingBuffer<int64_t> b{ 100000 };
+
+	// move the heads off 0 so the readable region crosses the mirror
+	b.advanceWriteHead(70000);
+	b.advanceReadHead(70000);
+
+	int64_t* buffer = b.writeBuffer();
+	for (int64_t i = 0; i < 60000; i++) {
+		buffer[i] = i;
+	}
+	b.advanceWriteHead(60000);
+
+	std::atomic<int64_t> sum{ 0 };
+	std::atomic<size_t> seen{ 0 };
+	std::atomic<size_t> misaligned{ 0 };
+
+	size_t consumed = parallelConsume(b, pool, [&](int64_t* begin, size_t count) {
+		int64_t local = 0;
+		for (size_t i = 0; i < count; i++) {
+			local += begin[i];
+		}
+		sum += local;
+		seen += count;
+		misaligned += (reinterpret_cast<uintptr_t>(begin + count) % 64 != 0) ? 1 : 0;
+	}, 1000);
+
+	ASSERT_EQ(60000, consumed);
+	ASSERT_EQ(60000, seen.load());
+	ASSERT_EQ(int64_t{ 59999 } * 60000 / 2, sum.load());
+	// only the last chunk may end off a cache line
+	ASSERT_TRUE(misaligned.load() <= 1);
+	ASSERT_FALSE(b.hasData());
+
+	consumed = parallelConsume(b, pool, [&](int64_t*, size_t) {});
+	ASSERT_EQ(0, consumed);
+}
+
+TEST(TEST_COPY_KERNELS) {
+	std::vector<char> src(300 * 1024 + 77);
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = static_cast<char>(i * 31 + 7);
+	}
+
+	// sizes around the threshold, misaligned both ways
+	size_t sizes[] = { 0, 1, 63, 64, 4097, CopyKernels::StreamingThreshold - 1, CopyKernels::StreamingThreshold, 300 * 1024 };
+	for (size_t size : sizes) {
+		for (size_t offset : { 0, 3, 61 }) {
+			std::vector<char> dst(src.size() + 64, 0);
+			CopyKernels::copy(dst.data() + offset, src.data() + 5, size);
+			ASSERT_EQ(0, memcmp(dst.data() + offset, src.data() + 5, size));
+			ASSERT_EQ(0, dst[offset + size]);
+		}
+	}
+
+	std::vector<char> dst(src.size());
+	CopyKernels::streamCopy(dst.data(), src.data(), 1000);
+	ASSERT_EQ(0, memcmp(dst.data(), src.data(), 1000));
+
+	// every level this cpu can run, not just the one picked
+	alignas(64) char lines[64 * 40];
+	for (int level = 0; level <= static_cast<int>(CopyKernels::cpuLevel()); level++) {
+		memset(lines, 0, sizeof(lines));
+		CopyKernels::streamLines(lines, src.data() + 1, sizeof(lines), static_cast<CopyKernels::Level>(level));
+		ASSERT_EQ(0, memcmp(lines, src.data() + 1, sizeof(lines)));
+	}
+}
+
+PERF_TEST(TEST_BATCH_COPY) {
+	RingBuffer<int64_t> b{ 32768 };
+
+	std::vector<int64_t> in(20000);
+	for (size_t i = 0; i < in.size(); i++) {
+		in[i] = static_cast<int64_t>(i);
+	}
+
+	b.writeBatch(in.data(), in.size());
+	std::vector<int64_t> out(in.size());
+	size_t read = b.readBatch(out.data(), out.size());
+	ASSERT_EQ(20000, read);
+	ASSERT_TRUE(in == out);
+
+	// crosses the end of the first view
+	b.writeBatch(in.data(), in.size());
+	ASSERT_EQ(20000, b.availableForRead());
+	read = b.readBatch(out.data(), 50000);
+	ASSERT_EQ(20000, read);
+	ASSERT_TRUE(in == out);
+
+	// too big : keeps the newest
+	std::vector<int64_t> big(40000, 1);
+	big.back() = 42;
+	b.writeBatch(big.data(), big.size());
+	ASSERT_EQ(32767, b.availableForRead());
+	ASSERT_EQ(42, b.readBuffer()[32766]);
+	ASSERT_EQ(80000, b.totalWritten());
+
+	RingBuffer<int64_t> clone{ b };
+	ASSERT_EQ(42, clone.readBuffer()[32766]);
+}
+
+TEST(TEST_BROADCAST_RING) {
+	BroadcastRingBuffer<int64_t> b{ 512 };
+	ASSERT_EQ(512, b.bucketCount());
+
+	auto r = b.reader();
+	std::vector<int64_t> out(1024);
+
+	for (int64_t i = 0; i < 100; i++) {
+		b.write(i);
+	}
+
+	auto res = r.read(out.data(), out.size());
+	ASSERT_EQ(100, res.count);
+	ASSERT_EQ(0, res.lost);
+	ASSERT_EQ(99, out[99]);
+
+	// lapped : resyncs on the oldest element still there
+	for (int64_t i = 100; i < 1100; i++) {
+		b.write(i);
+	}
+
+	res = r.read(out.data(), out.size());
+	ASSERT_EQ(512, res.count);
+	ASSERT_EQ(488, res.lost);
+	ASSERT_EQ(588, out[0]);
+	ASSERT_EQ(1099, out[511]);
+	ASSERT_EQ(1100, r.position());
+
+	// claimed but not published buckets are gone for readers
+	auto late = b.reader();
+	int64_t* w = b.claim(512);
+	auto lagging = BroadcastRingBuffer<int64_t>::Reader{ b, 1000 };
+	res = lagging.read(out.data(), out.size());
+	ASSERT_EQ(0, res.count);
+	ASSERT_EQ(100, res.lost);
+	for (int64_t i = 0; i < 512; i++) {
+		w[i] = 1100 + i;
+	}
+	b.publish();
+	res = late.read(out.data(), out.size());
+	ASSERT_EQ(512, res.count);
+	ASSERT_EQ(1611, out[511]);
+}
+
+PERF_TEST(TEST_BROADCAST_RING_CONCURRENT) {
+	BroadcastRingBuffer<int64_t> b{ 512 };
+	constexpr int64_t total = 2000000;
+	Perf::setOperations(total);
+
+	auto r = b.reader();
+	std::thread producer{ [&] {
+		for (int64_t i = 0; i < total; i++) {
+			b.write(i);
+		}
+	} };
+
+	// every element we get must be the one at its sequence number, never a stale one
+	std::vector<int64_t> out(64);
+	bool ok = true;
+	while (r.position() < total) {
+		uint64_t before = r.position();
+		auto res = r.read(out.data(), out.size());
+		for (size_t i = 0; i < res.count; i++) {
+			ok = ok && out[i] == static_cast<int64_t>(before + res.lost + i);
+		}
+	}
+	producer.join();
+
+	ASSERT_TRUE(ok);
+	ASSERT_EQ(total, r.position());
+}
+
+TEST(TEST_BROADCAST_RING_LAPPED_READER) {
+	BroadcastRingBuffer<int64_t> b{ 512 };
+	std::vector<int64_t> out(4 * 512);
+
+	for (int64_t i = 0; i < 1100; i++) {
+		b.write(i);
+	}
+
+	// ahead of the stream : nothing to read, not a huge span
+	auto ahead = BroadcastRingBuffer<int64_t>::Reader{ b, 5000 };
+	auto res = ahead.read(out.data(), out.size());
+	ASSERT_EQ(0, res.count);
+	ASSERT_EQ(5000, ahead.position());
+
+	// a reader that falls more than a lap behind, asking for more than the ring holds
+	constexpr int64_t total = 2000000;
+	auto r = b.reader();
+	std::thread producer{ [&] {
+		for (int64_t i = 1100; i < total; i += 256) {
+			int64_t* w = b.claim(256);
+			for (int64_t j = 0; j < 256; j++) {
+				w[j] = i + j;
+			}
+			b.publish();
+		}
+	} };
+
+	bool ok = true;
+	uint64_t lost = 0;
+	for (int reads = 0; r.position() < static_cast<uint64_t>(total) - 16; reads++) {
+		if (reads % 8 == 0) {
+			std::this_thread::yield();
+		}
+
+		uint64_t before = r.position();
+		res = r.read(out.data(), out.size());
+		ok = ok && res.count <= b.bucketCount();
+		for (size_t i = 0; i < res.count; i++) {
+			ok = ok && out[i] == static_cast<int64_t>(before + res.lost + i);
+		}
+		lost += res.lost;
+	}
+	producer.join();
+
+	ASSERT_TRUE(ok);
+	ASSERT_EQ(lost, r.totalLost());
+}
+
+TEST(TEST_PERF_COUNTERS) {
+	constexpr uint64_t count = 1 << 20;
+	RingBuffer<int64_t> b{ 32768 };
+	std::vector<int64_t> in(b.availableBuckets(), 7);
+
+	// fresh pages : the first pass over the ring has to fault them in
+	PerfReport cold = Perf::measure("cold write", b.availableBuckets(), [&] {
+		for (size_t i = 0; i < b.availableBuckets(); i++) {
+			b.write(static_cast<int64_t>(i));
+		}
+	});
+
+	PerfReport single = Perf::measure("write", count, [&] {
+		for (uint64_t i = 0; i < count; i++) {
+			b.write(static_cast<int64_t>(i));
+		}
+	}, 3);
+
+	// whole batches : the last one goes a bit past count
+	uint64_t batchOps = (count + in.size() - 1) / in.size() * in.size();
+	uint64_t writtenBefore = b.totalWritten();
+	PerfReport batch = Perf::measure("writeBatch", batchOps, [&] {
+		for (uint64_t i = 0; i < count; i += in.size()) {
+			b.writeBatch(in.data(), in.size());
+		}
+	}, 3);
+
+	cold.print(std::cout);
+	single.print(std::cout);
+	batch.print(std::cout);
+
+	ASSERT_TRUE(cold.total.pageFaults > 0);
+	ASSERT_TRUE(single.total.nanoseconds > 0);
+	ASSERT_TRUE(single.total.cycles > 0);
+	// the ring's own count agrees with the reported one
+	ASSERT_EQ(3 * batchOps, b.totalWritten() - writtenBefore);
+	// a memcpy per batch against a call per element
+	ASSERT_TRUE(batch.cyclesPerOp() < single.cyclesPerOp());
+
+	// what PERF_TEST runs
+	std::ostringstream out;
+	PerfReport test = Perf::runMeasured("measured", [&] {
+		Perf::setOperations(count);
+		for (uint64_t i = 0; i < count; i++) {
+			b.write(static_cast<int64_t>(i));
+		}
+	}, out);
+	ASSERT_EQ(count, test.operations);
+	ASSERT_TRUE(test.total.cycles > 0);
+	ASSERT_TRUE(out.str().find("measured: 1048576 ops") == 0);
+}
+
+TEST(TEST_SPSC_RING) {
+	SpscRingBuffer<int64_t> b{ 512 };
+	ASSERT_EQ(512, b.availableForWrite());
+
+	for (int64_t i = 0; i < 512; i++) {
+		ASSERT_TRUE(b.write(i));
+	}
+	ASSERT_TRUE(!b.write(512));
+	ASSERT_EQ(512, b.size());
+
+	b.advanceReadHead(500);
+	ASSERT_EQ(500, b.availableForWrite());
+
+	// batch across the end of the first view
+	int64_t* w = b.writeBuffer();
+	for (int64_t i = 0; i < 500; i++) {
+		w[i] = 512 + i;
+	}
+	b.advanceWriteHead(500);
+
+	ASSERT_EQ(512, b.availableForRead());
+	ASSERT_EQ(500, b.readBuffer()[0]);
+	ASSERT_EQ(1011, b.readBuffer()[511]);
+}
+
+TEST(TEST_PIPELINE) {
+	constexpr int64_t total = 1000000;
+	int64_t sum = 0;
+	int64_t count = 0;
+
+	Pipeline p{ 256 };
+	auto in = p.input<int64_t>(4096);
+
+	// keeps the even values, halved
+	in.then<int64_t>("filter", -1, [](const int64_t* src, size_t n, int64_t* dst) {
+		size_t out = 0;
+		for (size_t i = 0; i < n; i++) {
+			dst[out] = src[i] / 2;
+			out += (src[i] % 2 == 0);
+		}
+		return out;
+	}, 1024)
+	.then<int32_t>("narrow", 0, [](const int64_t* src, size_t n, int32_t* dst) {
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = static_cast<int32_t>(src[i]);
+		}
+		return n;
+	}, 1024)
+	.sink("sum", -1, [&](const int32_t* src, size_t n) {
+		for (size_t i = 0; i < n; i++) {
+			sum += src[i];
+		}
+		count += n;
+	});
+
+	p.start();
+
+	SpscRingBuffer<int64_t>& ring = in.ring();
+	for (int64_t i = 0; i < total;) {
+		size_t room = ring.availableForWrite();
+		int64_t* w = ring.writeBuffer();
+		size_t n = 0;
+		for (; n < room && i < total; n++, i++) {
+			w[n] = i;
+		}
+		ring.advanceWriteHead(n);
+	}
+
+	p.close();
+	p.join();
+
+	ASSERT_EQ(total / 2, count);
+	ASSERT_EQ((total / 2) * (total / 2 - 1) / 2, sum);
+
+	std::vector<Pipeline::StageStats> stats = p.stats();
+	ASSERT_EQ(3, stats.size());
+	ASSERT_TRUE(stats[0].name == "filter");
+	ASSERT_EQ(total, stats[0].processed);
+	ASSERT_EQ(total / 2, stats[1].processed);
+	ASSERT_EQ(total / 2, stats[2].processed);
+	ASSERT_EQ(0, stats[2].queueDepth);
+	ASSERT_TRUE(stats[1].pinned);
+	ASSERT_TRUE(!stats[0].pinned);
+}
+
+TEST(TEST_PIPELINE_MISUSE) {
+	auto identity = [](const int64_t* src, size_t n, int64_t* dst) {
+		memcpy(dst, src, n * sizeof(int64_t));
+		return n;
+	};
+	auto drop = [](const int64_t*, size_t) {};
+
+	// a second consumer on the same queue
+	{
+		Pipeline p;
+		auto in = p.input<int64_t>(4096);
+		in.sink("first", -1, drop);
+
+		bool threw = false;
+		try {
+			in.then<int64_t>("second", -1, identity, 4096);
+		}
+		catch (std::runtime_error&) {
+			threw = true;
+		}
+		ASSERT_TRUE(threw);
+
+		threw = false;
+		try {
+			in.sink("third", -1, drop);
+		}
+		catch (std::runtime_error&) {
+			threw = true;
+		}
+		ASSERT_TRUE(threw);
+
+		// the chain is still fine
+		p.start();
+		ASSERT_EQ(1, p.stats().size());
+	}
+
+	// no sink at the end : start refuses instead of hanging in the destructor
+	{
+		Pipeline p;
+		auto in = p.input<int64_t>(4096);
+		in.then<int64_t>("dangling", -1, identity, 4096);
+
+		bool threw = false;
+		try {
+			p.start();
+		}
+		catch (std::runtime_error&) {
+			threw = true;
+		}
+		ASSERT_TRUE(threw);
+		ASSERT_EQ(0, p.stats()[0].processed);
+	}
+}
+
+TEST(TEST_RING_CAPTURE_REPLAY) {
+	std::string path = (std::filesystem::temp_directory_path() / "ring_capture_test.rcap").string();
+
+	{
+		RingBuffer<int32_t> r{ 1024 };
+		RingCapture capture{ path, sizeof(int32_t), true };
+		r.setCapture(&capture);
+
+		r.write(1);
+		r.write(2);
+
+		int32_t* w = r.writeBuffer();
+		w[0] = 3; w[1] = 4; w[2] = 5;
+		r.advanceWriteHead(3);
+
+		std::vector<int32_t> batch(100, 6);
+		r.writeBatch(batch.data(), batch.size());
+
+		// bigger than the ring : recorded as it arrived, not trimmed
+		std::vector<int32_t> burst(2000, 8);
+		r.writeBatch(burst.data(), burst.size());
+
+		r.setCapture(nullptr);
+		r.write(7);
+
+		ASSERT_EQ(5, capture.recordCount());
+	}
+
+	RingCaptureReader capture{ path };
+	ASSERT_EQ(sizeof(int32_t), capture.elementSize());
+	ASSERT_TRUE(capture.hasPayload());
+
+	CaptureRecord record{};
+	ASSERT_TRUE(capture.next(record));
+	ASSERT_EQ(1, record.count);
+	ASSERT_TRUE(capture.next(record));
+	ASSERT_TRUE(capture.next(record));
+	ASSERT_EQ(3, record.count);
+	int32_t last = 0;
+	memcpy(&last, record.payload + 2 * sizeof(int32_t), sizeof(last));
+	ASSERT_EQ(5, last);
+	ASSERT_TRUE(capture.next(record));
+	ASSERT_EQ(100, record.count);
+	ASSERT_TRUE(capture.next(record));
+	ASSERT_EQ(2000, record.count);
+	ASSERT_TRUE(!capture.next(record));
+
+	// replays the same batches, into a smaller ring
+	RingBuffer<int32_t> target{ 64 };
+	int64_t sum = 0;
+	ReplayStats stats = replayCapture(capture, target, [&](RingBuffer<int32_t>& ring) {
+		while (ring.hasData()) {
+			sum += ring.read();
+		}
+	});
+
+	ASSERT_EQ(5, stats.records);
+	ASSERT_EQ(2105, stats.elements);
+	ASSERT_EQ(1 + 2 + 3 + 4 + 5 + 63 * 6 + 63 * 8, sum);
+
+	std::filesystem::remove(path);
+}
+
+TEST(TEST_RING_LOGGER) {
+	std::string path = (std::filesystem::temp_directory_path() / "ring_logger_test.log").string();
+
+	{
+		RingLogger log{ path, 64 * 1024 };
+
+		std::thread other{ [&] {
+			for (int i = 0; i < 1000; i++) {
+				RING_LOG(log, "other {}", i);
+			}
+		} };
+
+		for (int i = 0; i < 1000; i++) {
+			RING_LOG(log, "main {} ratio {} ok {}", i, i / 4.0, i % 2 == 0);
+		}
+		RING_LOG(log, "no args");
+		RING_LOG(log, "char {} extra", 'x', int64_t{ -5 });
+
+		other.join();
+		log.flush();
+		ASSERT_EQ(0, log.dropped());
+	}
+
+	std::ifstream file{ path };
+	std::vector<std::string> lines;
+	for (std::string line; std::getline(file, line);) {
+		lines.push_back(line);
+	}
+
+	ASSERT_EQ(2002, lines.size());
+	ASSERT_TRUE(std::find(lines.begin(), lines.end(), "main 42 ratio 10.5 ok true") != lines.end());
+	ASSERT_TRUE(std::find(lines.begin(), lines.end(), "other 999") != lines.end());
+	ASSERT_TRUE(std::find(lines.begin(), lines.end(), "no args") != lines.end());
+	ASSERT_TRUE(std::find(lines.begin(), lines.end(), "char x extra -5") != lines.end());
+
+	file.close();
+	std::filesystem::remove(path);
+}
+
+TEST(TEST_RING_LOGGER_WRAPS) {
+	std::string path = (std::filesystem::temp_directory_path() / "ring_logger_wrap_test.log").string();
+	const int count = 50000;
+
+	{
+		RingLogger log{ path, 4096 };
+
+		// Way more than the ring holds : retries until the backend made room.
+		// 20 bytes records don't fill it exactly, a few bytes are always left over.
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 10 };
+		int logged = 0;
+		while (logged < count && std::chrono::steady_clock::now() < deadline) {
+			if (RING_LOG(log, "record {} of {} ({})", logged, count, logged % 7)) {
+				logged++;
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+
+		ASSERT_EQ(count, logged);
+		ASSERT_TRUE(log.dropped() > 0);
+		log.flush();
+	}
+
+	std::ifstream file{ path };
+	size_t lines = 0;
+	std::string last;
+	for (std::string line; std::getline(file, line); lines++) {
+		last = line;
+	}
+
+	ASSERT_EQ(count, lines);
+	ASSERT_EQ("record 49999 of 50000 (5)", last);
+
+	file.close();
+	std::filesystem::remove(path);
+}
+
+TEST(TEST_RING_LOGGER_THREAD_RINGS) {
+	std::string pathA = (std::filesystem::temp_directory_path() / "ring_logger_a.log").string();
+	std::string pathB = (std::filesystem::temp_directory_path() / "ring_logger_b.log").string();
+
+	{
+		RingLogger a{ pathA, 4096 };
+		RingLogger b{ pathB, 4096 };
+
+		// Switching back and forth keeps one ring per logger
+		for (int i = 0; i < 100; i++) {
+			RING_LOG(a, "a {}", i);
+			RING_LOG(b, "b {}", i);
+		}
+		ASSERT_EQ(1, a.ringCount());
+		ASSERT_EQ(1, b.ringCount());
+
+		// An exited thread's ring goes to the next thread
+		for (int t = 0; t < 10; t++) {
+			std::thread{ [&] { RING_LOG(a, "thread {}", t); } }.join();
+		}
+		ASSERT_EQ(2, a.ringCount());
+		ASSERT_EQ(1, b.ringCount());
+
+		a.flush();
+		b.flush();
+		ASSERT_EQ(0, a.dropped());
+	}
+
+	std::ifstream file{ pathA };
+	size_t lines = 0;
+	for (std::string line; std::getline(file, line); lines++) {
+	}
+	ASSERT_EQ(110, lines);
+
+	file.close();
+	std::filesystem::remove(pathA);
+	std::filesystem::remove(pathB);
+
+	// A logger created after the others were destroyed gets its own ring
+	{
+		RingLogger c{ pathA, 4096 };
+		RING_LOG(c, "c");
+		ASSERT_EQ(1, c.ringCount());
+	}
+	std::filesystem::remove(pathA);
+}
+
+TEST(TEST_MIRROR_REGISTRY) {
+	MirrorRegistry& registry = MirrorRegistry::instance();
+
+	// buffers from before it's enabled aren't tracked
+	RingBuffer<char> before{ 4096 };
+	MirrorRegistry::enable();
+	size_t baseCount = registry.count();
+	size_t baseBytes = registry.totalBytes();
+
+	{
+		uint32_t line = std::source_location::current().line() + 1;
+		RingBuffer<int64_t> ticks{ 1024, RingSizing::Pages, "ticks" };
+		RingBuffer<char> untagged{ 4096 };
+
+		ASSERT_EQ(baseCount + 2, registry.count());
+		ASSERT_EQ(baseBytes + 8192 + 4096, registry.totalBytes());
+		ASSERT_EQ(2 * registry.totalBytes(), registry.totalAddressSpace());
+
+		std::vector<MirrorRegistry::Entry> entries = registry.entries();
+		auto it = std::find_if(entries.begin(), entries.end(), [](const MirrorRegistry::Entry& e) { return e.tag == "ticks"; });
+		ASSERT_TRUE(it != entries.end());
+		ASSERT_EQ(8192, it->size);
+		ASSERT_EQ(line, it->site.line());
+
+		ASSERT_EQ(0, MirrorRegistry::residentBytes(it->base, it->size));
+		for (int i = 0; i < 600; i++) {
+			ticks.write(i);
+		}
+		ASSERT_EQ(8192, MirrorRegistry::residentBytes(it->base, it->size));
+		ASSERT_TRUE(registry.totalResidentBytes() >= 8192);
+
+		// copies are registered like the original
+		{
+			RingBuffer<int64_t> clone{ ticks };
+			entries = registry.entries();
+			size_t tagged = std::count_if(entries.begin(), entries.end(), [&](const MirrorRegistry::Entry& e) {
+				return e.tag == "ticks" && e.site.line() == line;
+			});
+			ASSERT_EQ(2, tagged);
+		}
+
+		// so are snapshots, they pin the section as long as they live
+		{
+			RingSnapshot<int64_t> snap = ticks.snapshot();
+			ASSERT_EQ(baseCount + 3, registry.count());
+			ASSERT_EQ(baseBytes + 2 * 8192 + 4096, registry.totalBytes());
+
+			std::ostringstream report;
+			registry.report(report);
+			size_t first = report.str().find("ticks: 8192 bytes");
+			ASSERT_TRUE(first != std::string::npos);
+			ASSERT_TRUE(report.str().find("ticks: 8192 bytes", first + 1) != std::string::npos);
+
+			// and count against the budget
+			registry.setBudget(registry.totalBytes());
+			bool thrown = false;
+			try {
+				RingSnapshot<int64_t> tooMany = ticks.snapshot();
+			}
+			catch (std::runtime_error&) {
+				thrown = true;
+			}
+			ASSERT_TRUE(thrown);
+			ASSERT_EQ(baseCount + 3, registry.count());
+			registry.setBudget(0);
+		}
+		ASSERT_EQ(baseCount + 2, registry.count());
+
+		// over budget : throws and doesn't leak an entry
+		registry.setBudget(registry.totalBytes() + 4096);
+		RingBuffer<char> fits{ 4096 };
+		bool thrown = false;
+		try {
+			RingBuffer<char> tooBig{ 4096 };
+		}
+		catch (std::runtime_error&) {
+			thrown = true;
+		}
+		ASSERT_TRUE(thrown);
+		ASSERT_EQ(baseCount + 3, registry.count());
+		ASSERT_EQ(registry.budget(), registry.totalBytes());
+
+		registry.report(std::cout);
+	}
+
+	ASSERT_EQ(baseCount, registry.count());
+	ASSERT_EQ(baseBytes, registry.totalBytes());
+
+	registry.setBudget(0);
+	MirrorRegistry::enable(false);
+}
+
+TEST(TEST_DELTA_RING_BUFFER) {
+	DeltaRingBuffer b{ 64 * 1024 };
+
+	// ids moving by small steps, a few jumps both ways
+	std::vector<uint64_t> in;
+	uint64_t id = 1000000000000ull;
+	for (size_t i = 0; i < 20000; i++) {
+		id += (i * 7919) % 97;
+		in.push_back(id);
+	}
+	in[5000] = 3;
+	in[5001] = UINT64_MAX;
+
+	for (uint64_t v : in) {
+		b.push(v);
+	}
+	ASSERT_EQ(20000 % DeltaRingBuffer::BlockSize, b.stagedValues());
+	b.flush();
+	ASSERT_EQ(20000, b.availableValues());
+	ASSERT_TRUE(b.compressedBytes() * 6 < in.size() * sizeof(uint64_t));
+
+	std::vector<uint64_t> out;
+	uint64_t block[DeltaRingBuffer::BlockSize];
+	for (size_t n = b.readBlock(block); n != 0; n = b.readBlock(block)) {
+		out.insert(out.end(), block, block + n);
+	}
+	ASSERT_TRUE(in == out);
+	ASSERT_EQ(0, b.availableValues());
+
+	// too small to keep it all : the oldest blocks go
+	DeltaRingBuffer small{ 4096 };
+	for (uint64_t v : in) {
+		small.push(v);
+	}
+	small.flush();
+	ASSERT_EQ(20000, small.evictedValues() + small.availableValues());
+	ASSERT_TRUE(small.evictedValues() > 0);
+
+	out.clear();
+	for (size_t n = small.readBlock(block); n != 0; n = small.readBlock(block)) {
+		out.insert(out.end(), block, block + n);
+	}
+	ASSERT_TRUE(std::equal(out.begin(), out.end(), in.end() - out.size()));
+}
+
+TEST(TEST_RING_FLUSHER) {
+	char tempDir[MAX_PATH];
+	GetTempPathA(MAX_PATH, tempDir);
+	std::string path = std::string{ tempDir } + "ring_flusher_test.bin";
+
+	std::vector<char> expected;
+	auto produce = [&](RingBuffer<char>& ring, size_t count) {
+		for (size_t i = 0; i < count; i++) {
+			char c = static_cast<char>((expected.size() * 31) % 251);
+			ring.write(c);
+			expected.push_back(c);
+		}
+	};
+
+	auto fileContent = [&]() {
+		std::ifstream file{ path, std::ios::binary };
+		return std::vector<char>{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+	};
+
+	RingBuffer<char> ring{ 65536 };
+
+	{
+		RingFlusher flusher{ path };
+
+		// several rounds, going around the ring more than once
+		for (int round = 0; round < 10; round++) {
+			produce(ring, 30000);
+			flusher.drain(ring);
+			ASSERT_TRUE(ring.availableForRead() < System::getPageSize());
+		}
+
+		produce(ring, 123);
+		flusher.finish(ring);
+		ASSERT_EQ(expected.size(), flusher.bytesWritten());
+		ASSERT_EQ(0, ring.availableForRead());
+	}
+	ASSERT_TRUE(fileContent() == expected);
+
+	// read head off a block boundary : goes through the bounce buffer
+	expected.clear();
+	ring.write('x');
+	ring.read();
+	{
+		RingFlusher flusher{ path };
+		produce(ring, 50000);
+		size_t drained = flusher.drain(ring);
+		ASSERT_EQ(49152, drained);
+		flusher.finish(ring);
+	}
+	ASSERT_TRUE(fileContent() == expected);
+
+	DeleteFileA(path.c_str());
+}
+
+TEST(TEST_PRIORITY_RING_SET) {
+	PriorityRingSet<int> strict{ DrainMode::Strict };
+	size_t control = strict.addLane(1024);
+	size_t bulk = strict.addLane(8192);
+
+	for (int i = 0; i < 5000; i++) {
+		strict.lane(bulk).write(i);
+	}
+
+	auto batch = strict.nextBatch(256);
+	ASSERT_EQ(bulk, batch.lane);
+	ASSERT_EQ(256, batch.count);
+	strict.consume(batch);
+
+	// control preempts bulk right away
+	strict.lane(control).write(-1);
+	batch = strict.nextBatch(256);
+	ASSERT_EQ(control, batch.lane);
+	ASSERT_EQ(1, batch.count);
+	ASSERT_EQ(-1, batch.data[0]);
+	strict.consume(batch);
+
+	batch = strict.nextBatch(256);
+	ASSERT_EQ(bulk, batch.lane);
+	ASSERT_EQ(256, batch.data[0]);
+
+	// weights 1 : 2 : 4, everything backlogged
+	PriorityRingSet<int> weighted{ DrainMode::Weighted };
+	std::vector<size_t> drained(3, 0);
+	for (size_t w : { 100, 200, 400 }) {
+		size_t lane = weighted.addLane(16384, w);
+		for (int i = 0; i < 10000; i++) {
+			weighted.lane(lane).write(i);
+		}
+	}
+
+	for (size_t total = 0; total < 7000;) {
+		batch = weighted.nextBatch(64);
+		ASSERT_TRUE(batch.count <= 64);
+		drained[batch.lane] += batch.count;
+		total += batch.count;
+		weighted.consume(batch);
+	}
+	ASSERT_EQ(1000, drained[0]);
+	ASSERT_EQ(2000, drained[1]);
+	ASSERT_EQ(4000, drained[2]);
+
+	// an empty lane doesn't hold the others back
+	while (weighted.lane(1).availableForRead() != 0) {
+		weighted.lane(1).advanceReadHead(weighted.lane(1).availableForRead());
+	}
+	for (size_t i = 0; i < 10; i++) {
+		batch = weighted.nextBatch(1000);
+		ASSERT_TRUE(batch.lane != 1);
+		weighted.consume(batch);
+	}
+
+	for (size_t lane = 0; lane < 3; lane++) {
+		weighted.lane(lane).advanceReadHead(weighted.lane(lane).availableForRead());
+	}
+	batch = weighted.nextBatch(64);
+	ASSERT_EQ(0, batch.count);
+}
+
+TEST(TEST_BIT_STREAM) {
+	RingBuffer<uint8_t> ring{ 4096 };
+	BitWriter writer{ ring };
+	BitReader reader{ ring };
+
+	auto field = [](uint64_t i) {
+		unsigned bits = 1 + static_cast<unsigned>((i * 13) % BitStream::MaxBits);
+		uint64_t value = (i * 0x9E3779B97F4A7C15ull) & BitStream::lowBits(bits);
+		return std::make_pair(value, bits);
+	};
+
+	// rounds of ~1 KB : goes around the ring plenty of times
+	uint64_t written = 0;
+	uint64_t read = 0;
+	bool ok = true;
+	for (int round = 0; round < 200; round++) {
+		size_t bits = 0;
+		for (int i = 0; i < 300; i++, written++) {
+			auto [value, width] = field(written);
+			writer.write(value, width);
+			bits += width;
+		}
+		writer.alignToByte();
+		writer.commit();
+		ASSERT_EQ(0, writer.pendingBits());
+		ASSERT_TRUE(reader.bitsAvailable() >= bits);
+
+		for (int i = 0; i < 300; i++, read++) {
+			auto [value, width] = field(read);
+			ok = ok && reader.read(width) == value;
+		}
+		reader.alignToByte();
+		reader.release();
+		ASSERT_EQ(0, reader.bitsAvailable());
+	}
+	ASSERT_TRUE(ok);
+
+	// the writer wants 8 bytes past the current one
+	RingBuffer<uint8_t> small{ 4096 };
+	BitWriter full{ small };
+	bool thrown = false;
+	size_t bytes = 0;
+	try {
+		for (;; bytes++) {
+			full.write(0xAB, 8);
+		}
+	}
+	catch (std::runtime_error&) {
+		thrown = true;
+	}
+	ASSERT_TRUE(thrown);
+	ASSERT_EQ(4095 - 8 + 1, bytes);
+}
+
+struct ORDER {
+	uint64_t seq;
+	double price;
+	uint32_t lots;
+};
+
+TEST(TEST_SLOT_POOL) {
+	SlotPool<ORDER> pool{ 64 };
+	ASSERT_EQ(64, pool.slotCount());
+
+	// cache line aligned slots, until there's none left
+	std::vector<ORDER*> claimed;
+	while (ORDER* o = pool.claim()) {
+		ASSERT_EQ(0, reinterpret_cast<uintptr_t>(o) % 64);
+		o->seq = claimed.size();
+		claimed.push_back(o);
+	}
+	ASSERT_EQ(64, claimed.size());
+	ASSERT_TRUE(pool.front() == nullptr);
+
+	pool.publish();
+	ASSERT_TRUE(pool.front() == claimed[0]);
+	pool.release();
+	ASSERT_EQ(1, pool.front()->seq);
+	ORDER* next = pool.claim();
+	ASSERT_TRUE(next == claimed[0]);
+	pool.publish();
+
+	for (uint64_t i = 1; i < 64; i++) {
+		pool.release();
+	}
+	ASSERT_TRUE(pool.front() == next);
+	pool.release();
+	ASSERT_TRUE(pool.front() == nullptr);
+
+	// handoff between threads
+	constexpr uint64_t total = 1000000;
+	SlotPool<ORDER> shared{ 1024 };
+	std::thread producer{ [&] {
+		for (uint64_t i = 0; i < total;) {
+			if (ORDER* o = shared.claim()) {
+				o->seq = i;
+				o->price = i * 0.5;
+				o->lots = static_cast<uint32_t>(i % 100);
+				shared.publish();
+				i++;
+			}
+		}
+	} };
+
+	bool ok = true;
+	for (uint64_t i = 0; i < total;) {
+		if (ORDER* o = shared.front()) {
+			ok = ok && o->seq == i && o->price == i * 0.5 && o->lots == i % 100;
+			shared.release();
+			i++;
+		}
+	}
+	producer.join();
+	ASSERT_TRUE(ok);
+}
+
 
 TEST_MAIN();
\ No newline at end of file
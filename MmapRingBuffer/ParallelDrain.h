@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+
+// Fixed set of worker threads running one indexed job at a time.
+//
+// run(n, job) calls job(i) for every i in [0, n). Workers (and the calling
+// thread, which pitches in) grab the next index from a shared atomic counter,
+// so a worker that's done early just takes more tasks : same balancing as
+// work stealing without per thread queues, tasks here being all alike.
+class WorkerPool {
+public:
+	// Number of extra threads. The calling thread also works, so
+	// concurrency() is nbThreads + 1.
+	WorkerPool(size_t nbThreads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t concurrency() const { return _threads.size() + 1; }
+
+	// Returns once every task is done. If tasks throw, the first exception
+	// is rethrown here after the others are done.
+	void run(size_t nbTasks, const std::function<void(size_t)>& job);
+
+private:
+	void workerLoop();
+	void work();
+
+private:
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+
+	const std::function<void(size_t)>* _job{ nullptr };
+	size_t _nbTasks{ 0 };
+	std::atomic<size_t> _next{ 0 };
+	std::exception_ptr _error{};
+
+	uint64_t _generation{ 0 };
+	size_t _active{ 0 };
+	bool _stop{ false };
+};
+
+inline WorkerPool::WorkerPool(size_t nbThreads)
+{
+	_threads.reserve(nbThreads);
+	for (size_t i = 0; i < nbThreads; i++)
+	{
+		_threads.emplace_back([this] { workerLoop(); });
+	}
+}
+
+inline WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (std::thread& t : _threads)
+	{
+		t.join();
+	}
+}
+
+inline void WorkerPool::run(size_t nbTasks, const std::function<void(size_t)>& job)
+{
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		_job = &job;
+		_nbTasks = nbTasks;
+		_next.store(0, std::memory_order_relaxed);
+		_error = nullptr;
+		_active = _threads.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> lock{ _mutex };
+	_done.wait(lock, [this] { return _active == 0; });
+	_job = nullptr;
+
+	if (_error)
+	{
+		std::rethrow_exception(_error);
+	}
+}
+
+inline void WorkerPool::workerLoop()
+{
+	uint64_t seen = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			_wake.wait(lock, [&] { return _stop || _generation != seen; });
+
+			if (_stop)
+			{
+				return;
+			}
+
+			seen = _generation;
+		}
+
+		work();
+
+		std::lock_guard<std::mutex> lock{ _mutex };
+		if (--_active == 0)
+		{
+			_done.notify_one();
+		}
+	}
+}
+
+inline void WorkerPool::work()
+{
+	for (size_t i = _next.fetch_add(1); i < _nbTasks; i = _next.fetch_add(1))
+	{
+		try
+		{
+			(*_job)(i);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			if (!_error)
+			{
+				_error = std::current_exception();
+			}
+		}
+	}
+}
+
+// Processes everything readable in ring on the pool then consumes it with a
+// single advanceReadHead.
+//
+// fn(T* begin, size_t count) is called concurrently on disjoint chunks of the
+// readable region. Thanks to the mirror the region is one array, so chunks are
+// just pointer ranges : nothing is copied out of the ring. Chunk boundaries
+// fall on cache lines when sizeof(T) allows it, so two workers never write to
+// the same line.
+//
+// chunkSize is in elements, 0 picks ~4 chunks per thread. Only the calling
+// thread touches the ring heads. Returns the number of consumed elements.
+template <typename T, typename Fn>
+size_t parallelConsume(RingBuffer<T>& ring, WorkerPool& pool, Fn&& fn, size_t chunkSize = 0)
+{
+	constexpr size_t CacheLine = 64;
+
+	size_t count = ring.availableForRead();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	T* data = ring.readBuffer();
+
+	// Elements per cache line multiple, and the elements before the first line boundary.
+	size_t granularity = CacheLine / std::gcd(CacheLine, sizeof(T));
+	size_t head = 0;
+	if (CacheLine % sizeof(T) == 0)
+	{
+		size_t misalignment = reinterpret_cast<uintptr_t>(data) % CacheLine;
+		head = ((CacheLine - misalignment) % CacheLine) / sizeof(T);
+		head = head < count ? head : count;
+	}
+
+	if (chunkSize == 0)
+	{
+		chunkSize = count / (pool.concurrency() * 4);
+	}
+	chunkSize = (chunkSize + granularity - 1) / granularity * granularity;
+	chunkSize = chunkSize == 0 ? granularity : chunkSize;
+
+	// Task 0 is the unaligned head (possibly empty), then whole chunks.
+	size_t nbTasks = 1 + (count - head + chunkSize - 1) / chunkSize;
+
+	pool.run(nbTasks, [&](size_t task) {
+		size_t begin = (task == 0) ? 0 : head + (task - 1) * chunkSize;
+		size_t end = (task == 0) ? head : head + task * chunkSize;
+		end = end < count ? end : count;
+
+		if (end > begin)
+		{
+			fn(data + begin, end - begin);
+		}
+	});
+
+	ring.advanceReadHead(count);
+
+	return count;
+}
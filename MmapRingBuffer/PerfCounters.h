@@ -0,0 +1,154 @@
+#pragma once
+
+#include <windows.h>
+#include <Psapi.h>
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+
+// Measurement layer for benchmarks and tests : wraps a piece of code and
+// reports what it cost per operation.
+//
+//   PerfReport r = Perf::measure("write", 1'000'000, [&] { for (...) ring.write(x); });
+//   r.print(std::cout);
+//
+// Whole microtest cases are measured by declaring them with PERF_TEST instead of
+// TEST, see below.
+//
+// What Windows lets a user mode process read is wall time (QPC), the cycles
+// charged to the calling thread (QueryThreadCycleTime, counts only while the
+// thread is scheduled) and the process page fault count. Instruction, cache and
+// TLB miss counters (PMU events) are only reachable from kernel mode there
+// (ETW PMC sources, VTune, WPR), so they're not part of the report : run the
+// same binary under one of those when the cycles alone don't explain it.
+struct PerfSample {
+	uint64_t nanoseconds{ 0 };
+	uint64_t cycles{ 0 };
+	uint64_t pageFaults{ 0 };
+
+	PerfSample operator-(const PerfSample& rhs) const
+	{
+		return PerfSample{ nanoseconds - rhs.nanoseconds, cycles - rhs.cycles, pageFaults - rhs.pageFaults };
+	}
+};
+
+struct PerfReport {
+	const char* name{ "" };
+	uint64_t operations{ 0 };
+	PerfSample total{};
+
+	double nanosecondsPerOp() const { return perOp(total.nanoseconds); }
+	double cyclesPerOp() const { return perOp(total.cycles); }
+	double pageFaultsPerOp() const { return perOp(total.pageFaults); }
+
+	void print(std::ostream& out) const;
+
+private:
+	double perOp(uint64_t value) const { return operations == 0 ? 0.0 : static_cast<double>(value) / static_cast<double>(operations); }
+};
+
+namespace Perf {
+
+	// Current values of the counters, for the calling thread / process.
+	inline PerfSample sample()
+	{
+		static const uint64_t frequency = [] {
+			LARGE_INTEGER f{};
+			QueryPerformanceFrequency(&f);
+			return static_cast<uint64_t>(f.QuadPart);
+		}();
+
+		PerfSample s{};
+
+		LARGE_INTEGER counter{};
+		QueryPerformanceCounter(&counter);
+		uint64_t ticks = static_cast<uint64_t>(counter.QuadPart);
+		// Split to avoid overflowing ticks * 1e9
+		s.nanoseconds = ticks / frequency * 1'000'000'000ull + ticks % frequency * 1'000'000'000ull / frequency;
+
+		ULONG64 cycles = 0;
+		QueryThreadCycleTime(GetCurrentThread(), &cycles);
+		s.cycles = cycles;
+
+		PROCESS_MEMORY_COUNTERS memory{};
+		memory.cb = sizeof(memory);
+		GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+		s.pageFaults = memory.PageFaultCount;
+
+		return s;
+	}
+
+	// Runs fn repetitions times and reports the fastest run (fewest cycles),
+	// operations being what a single run of fn does. The first runs are the
+	// ones paying for page faults, the warm numbers are usually what we're after :
+	// use repetitions = 1 to see the cold ones.
+	template <typename Fn>
+	PerfReport measure(const char* name, uint64_t operations, Fn&& fn, unsigned repetitions = 1)
+	{
+		PerfReport report{ name, operations };
+
+		for (unsigned i = 0; i < repetitions; i++)
+		{
+			PerfSample before = sample();
+			fn();
+			PerfSample run = sample() - before;
+
+			if (i == 0 || run.cycles < report.total.cycles)
+			{
+				report.total = run;
+			}
+		}
+
+		return report;
+	}
+
+	// Operation count of the measured test running on this thread.
+	inline uint64_t& currentOperations()
+	{
+		thread_local uint64_t operations = 1;
+		return operations;
+	}
+
+	// Inside a PERF_TEST : how many operations the test does, for the per
+	// operation numbers. The whole test counts as one operation otherwise.
+	inline void setOperations(uint64_t operations) { currentOperations() = operations; }
+
+	// Runs a test body once, measured, and prints the report. Used by PERF_TEST.
+	template <typename Fn>
+	PerfReport runMeasured(const char* name, Fn&& fn, std::ostream& out = std::cout)
+	{
+		currentOperations() = 1;
+		PerfReport report = measure(name, 1, fn);
+		report.operations = currentOperations();
+
+		report.print(out);
+		return report;
+	}
+};
+
+// Same as microtest's TEST, but the body runs under Perf::runMeasured : the test
+// prints its cost (per Perf::setOperations operation) after it passes. Counters
+// are the calling thread's, work done by threads the test starts only shows in
+// the wall time.
+#define PERF_TEST(name) \
+	void name##_measured(); \
+	TEST(name) { Perf::runMeasured(#name, name##_measured); } \
+	void name##_measured()
+
+inline void PerfReport::print(std::ostream& out) const
+{
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(2)
+		<< name << ": " << operations << " ops, "
+		<< nanosecondsPerOp() << " ns/op, "
+		<< cyclesPerOp() << " cycles/op, "
+		<< std::setprecision(4) << pageFaultsPerOp() << " faults/op"
+		<< std::endl;
+
+	out.flags(flags);
+	out.precision(precision);
+}
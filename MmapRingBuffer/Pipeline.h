@@ -0,0 +1,365 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRingBuffer.h"
+
+// Chain of stage threads connected by SpscRingBuffers.
+//
+//   Pipeline p;
+//   auto in = p.input<Packet>(4096);
+//   in.then<Parsed>("parse", 2, parse, 4096)
+//     .then<Frame>("encode", 3, encode, 4096)
+//     .sink("ship", 4, ship);
+//   p.start();
+//   ... feed in.ring() ...
+//   p.close();   // once the input is done, stages drain and exit in order
+//   p.join();
+//
+// A transform stage is size_t fn(const In* in, size_t count, Out* out) : out has
+// room for count elements, fn returns how many it produced (filters return less).
+// A sink is void fn(const In* in, size_t count). Spans come straight from the
+// rings, contiguous thanks to the mirror, at most maxBatch elements at a time.
+// A queue has exactly one consumer : then / sink once per Link, and the chain
+// has to end with a sink, start() throws otherwise.
+//
+// Each stage runs on its own thread, pinned to the given core (-1 for no
+// pinning), and polls its input : stages are meant to own a core, an idle one
+// yields but doesn't sleep.
+class Pipeline {
+public:
+	struct StageStats {
+		std::string name;
+		int core;
+		bool pinned;
+		// Elements taken from the input queue so far.
+		uint64_t processed;
+		// Elements waiting in the input queue, and its size.
+		size_t queueDepth;
+		size_t queueCapacity;
+	};
+
+	template <typename T>
+	class Link;
+
+	Pipeline(size_t maxBatch = 1024) : _maxBatch{ maxBatch } {}
+	~Pipeline();
+
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+
+	// Entry queue of the pipeline. The caller's thread is its producer.
+	template <typename T>
+	Link<T> input(size_t capacity);
+
+	// Launches the stage threads. Stages can't be added afterwards.
+	void start();
+
+	// No more input : stages finish what's queued and exit.
+	void close();
+
+	void join();
+
+	std::vector<StageStats> stats() const;
+
+private:
+	// Type erased queue between two stages.
+	struct Queue {
+		virtual ~Queue() {}
+		virtual size_t depth() const = 0;
+		virtual size_t capacity() const = 0;
+
+		// Set by the upstream side once it won't write anymore.
+		std::atomic<bool> closed{ false };
+		// A stage reads it. Rings are single consumer.
+		bool consumed{ false };
+	};
+
+	template <typename T>
+	struct TypedQueue : Queue {
+		TypedQueue(size_t capacity) : ring{ capacity } {}
+		size_t depth() const override { return ring.size(); }
+		size_t capacity() const override { return ring.bucketCount(); }
+
+		SpscRingBuffer<T> ring;
+	};
+
+	struct Stage {
+		std::string name;
+		int core;
+		Queue* input;
+		Queue* output;
+
+		// One batch, returns how many input elements were consumed.
+		std::function<size_t()> step;
+
+		std::atomic<uint64_t> processed{ 0 };
+		std::atomic<bool> pinned{ false };
+		std::thread thread;
+	};
+
+	template <typename T>
+	TypedQueue<T>* addQueue(size_t capacity);
+
+	// Marks queue as read by the next stage, throws if it already is.
+	void takeQueue(Queue* queue);
+
+	Stage& addStage(const std::string& name, int core, Queue* input, Queue* output);
+
+	void run(Stage& stage);
+
+private:
+	size_t _maxBatch;
+	bool _started{ false };
+
+	std::vector<std::unique_ptr<Queue>> _queues;
+	std::vector<std::unique_ptr<Stage>> _stages;
+};
+
+// Builder handle on the queue carrying T.
+template <typename T>
+class Pipeline::Link {
+public:
+	Link(Pipeline& pipeline, TypedQueue<T>& queue) : _pipeline{ &pipeline }, _queue{ &queue } {}
+
+	SpscRingBuffer<T>& ring() { return _queue->ring; }
+
+	template <typename Out, typename Fn>
+	Link<Out> then(const std::string& name, int core, Fn fn, size_t capacity);
+
+	template <typename Fn>
+	void sink(const std::string& name, int core, Fn fn);
+
+private:
+	Pipeline* _pipeline;
+	TypedQueue<T>* _queue;
+};
+
+template <typename T>
+Pipeline::TypedQueue<T>* Pipeline::addQueue(size_t capacity)
+{
+	if (_started)
+	{
+		throw std::runtime_error{ "can't add to a started Pipeline" };
+	}
+
+	_queues.push_back(std::make_unique<TypedQueue<T>>(capacity));
+	return static_cast<TypedQueue<T>*>(_queues.back().get());
+}
+
+template <typename T>
+Pipeline::Link<T> Pipeline::input(size_t capacity)
+{
+	if (!_queues.empty())
+	{
+		throw std::runtime_error{ "Pipeline has a single input" };
+	}
+
+	return Link<T>{ *this, *addQueue<T>(capacity) };
+}
+
+template <typename T>
+template <typename Out, typename Fn>
+Pipeline::Link<Out> Pipeline::Link<T>::then(const std::string& name, int core, Fn fn, size_t capacity)
+{
+	_pipeline->takeQueue(_queue);
+
+	TypedQueue<Out>* output = _pipeline->addQueue<Out>(capacity);
+	SpscRingBuffer<T>* in = &_queue->ring;
+	SpscRingBuffer<Out>* out = &output->ring;
+	size_t maxBatch = _pipeline->_maxBatch;
+
+	_pipeline->addStage(name, core, _queue, output).step = [=]() mutable -> size_t {
+		size_t count = in->availableForRead();
+		size_t room = out->availableForWrite();
+		count = count < room ? count : room;
+		count = count < maxBatch ? count : maxBatch;
+
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		size_t produced = fn(static_cast<const T*>(in->readBuffer()), count, out->writeBuffer());
+		out->advanceWriteHead(produced);
+		in->advanceReadHead(count);
+
+		return count;
+	};
+
+	return Link<Out>{ *_pipeline, *output };
+}
+
+template <typename T>
+template <typename Fn>
+void Pipeline::Link<T>::sink(const std::string& name, int core, Fn fn)
+{
+	_pipeline->takeQueue(_queue);
+
+	SpscRingBuffer<T>* in = &_queue->ring;
+	size_t maxBatch = _pipeline->_maxBatch;
+
+	_pipeline->addStage(name, core, _queue, nullptr).step = [=]() mutable -> size_t {
+		size_t count = in->availableForRead();
+		count = count < maxBatch ? count : maxBatch;
+
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		fn(static_cast<const T*>(in->readBuffer()), count);
+		in->advanceReadHead(count);
+
+		return count;
+	};
+}
+
+inline Pipeline::~Pipeline()
+{
+	close();
+	join();
+}
+
+inline void Pipeline::takeQueue(Queue* queue)
+{
+	if (_started)
+	{
+		throw std::runtime_error{ "can't add to a started Pipeline" };
+	}
+
+	if (queue->consumed)
+	{
+		throw std::runtime_error{ "Pipeline queue already has a consumer" };
+	}
+
+	queue->consumed = true;
+}
+
+inline Pipeline::Stage& Pipeline::addStage(const std::string& name, int core, Queue* input, Queue* output)
+{
+	if (_started)
+	{
+		throw std::runtime_error{ "can't add to a started Pipeline" };
+	}
+
+	if (core >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+	{
+		throw std::runtime_error{ "Pipeline stage core out of range" };
+	}
+
+	_stages.push_back(std::make_unique<Stage>());
+	Stage& stage = *_stages.back();
+	stage.name = name;
+	stage.core = core;
+	stage.input = input;
+	stage.output = output;
+
+	return stage;
+}
+
+inline void Pipeline::start()
+{
+	if (_started)
+	{
+		return;
+	}
+
+	// A queue nobody reads fills up, its writer then never finishes and
+	// join() hangs. The input is the caller's business.
+	for (size_t i = 1; i < _queues.size(); i++)
+	{
+		if (!_queues[i]->consumed)
+		{
+			throw std::runtime_error{ "Pipeline must end with a sink" };
+		}
+	}
+
+	_started = true;
+	for (std::unique_ptr<Stage>& stage : _stages)
+	{
+		Stage* s = stage.get();
+		s->thread = std::thread{ [this, s] { run(*s); } };
+	}
+}
+
+inline void Pipeline::close()
+{
+	if (!_queues.empty())
+	{
+		_queues.front()->closed.store(true, std::memory_order_release);
+	}
+}
+
+inline void Pipeline::join()
+{
+	for (std::unique_ptr<Stage>& stage : _stages)
+	{
+		if (stage->thread.joinable())
+		{
+			stage->thread.join();
+		}
+	}
+}
+
+inline void Pipeline::run(Stage& stage)
+{
+	if (stage.core >= 0)
+	{
+		DWORD_PTR mask = static_cast<DWORD_PTR>(1) << stage.core;
+		stage.pinned.store(SetThreadAffinityMask(GetCurrentThread(), mask) != 0, std::memory_order_relaxed);
+	}
+
+	for (;;)
+	{
+		size_t count = stage.step();
+		if (count != 0)
+		{
+			stage.processed.fetch_add(count, std::memory_order_relaxed);
+			continue;
+		}
+
+		// closed is checked before the last look at the queue : everything
+		// written before it was set is visible by then.
+		if (stage.input->closed.load(std::memory_order_acquire) && stage.input->depth() == 0)
+		{
+			break;
+		}
+
+		std::this_thread::yield();
+	}
+
+	if (stage.output)
+	{
+		stage.output->closed.store(true, std::memory_order_release);
+	}
+}
+
+inline std::vector<Pipeline::StageStats> Pipeline::stats() const
+{
+	std::vector<StageStats> stats;
+	stats.reserve(_stages.size());
+
+	for (const std::unique_ptr<Stage>& stage : _stages)
+	{
+		stats.push_back(StageStats{
+			stage->name,
+			stage->core,
+			stage->pinned.load(std::memory_order_relaxed),
+			stage->processed.load(std::memory_order_relaxed),
+			stage->input->depth(),
+			stage->input->capacity()
+		});
+	}
+
+	return stats;
+}
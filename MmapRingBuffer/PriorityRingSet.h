@@ -0,0 +1,179 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "SpscRingBuffer.h"
+
+// How a PriorityRingSet picks the next lane.
+enum class DrainMode {
+	// Always the first non empty lane : lane 0 preempts everything else.
+	Strict,
+	// Deficit round robin : every round, a lane gets to hand out up to its
+	// weight in elements. No lane starves, bandwidth splits by weight.
+	Weighted
+};
+
+// Several SpscRingBuffers, one per priority lane, drained by a single consumer.
+//
+//   PriorityRingSet<Msg> set{ DrainMode::Strict };
+//   size_t control = set.addLane(1024);
+//   size_t bulk = set.addLane(1 << 20);
+//   ...
+//   auto batch = set.nextBatch(256);
+//   handle(batch.data, batch.count);
+//   set.consume(batch);
+//
+// Each lane has its own producer thread (see SpscRingBuffer), the set itself
+// belongs to the consumer thread. Batches are contiguous spans straight out of
+// the lane's ring.
+template <typename T>
+class PriorityRingSet {
+public:
+	struct Batch {
+		size_t lane;
+		T* data;
+		// 0 when every lane is empty.
+		size_t count;
+	};
+
+	PriorityRingSet(DrainMode mode = DrainMode::Strict) : _mode{ mode } {}
+
+	// Lanes are in priority order, the first added is the most urgent. weight
+	// only matters in Weighted mode. Returns the lane index. Add every lane
+	// before the producers start.
+	size_t addLane(size_t nbBuckets, size_t weight = 1);
+
+	SpscRingBuffer<T>& lane(size_t index) { return _lanes[index]->ring; }
+	size_t laneCount() const { return _lanes.size(); }
+
+	DrainMode mode() const { return _mode; }
+
+	// Up to max elements from the lane the mode picks. Nothing is consumed
+	// until consume(batch).
+	Batch nextBatch(size_t max);
+
+	void consume(const Batch& batch);
+
+private:
+	struct Lane {
+		Lane(size_t nbBuckets, size_t weight) : ring{ nbBuckets }, weight{ weight } {}
+
+		SpscRingBuffer<T> ring;
+		size_t weight;
+		size_t deficit{ 0 };
+	};
+
+	Batch strictBatch(size_t max);
+	Batch weightedBatch(size_t max);
+
+	// Weighted mode : on to the next lane of the round.
+	void nextLane()
+	{
+		_current = (_current + 1) % _lanes.size();
+		_credited = false;
+	}
+
+private:
+	DrainMode _mode;
+	// unique_ptr : the rings can't move.
+	std::vector<std::unique_ptr<Lane>> _lanes;
+
+	size_t _current{ 0 };
+	bool _credited{ false };
+};
+
+template <typename T>
+size_t PriorityRingSet<T>::addLane(size_t nbBuckets, size_t weight)
+{
+	if (weight == 0)
+	{
+		throw std::runtime_error{ "lane weight must be non-zero." };
+	}
+
+	_lanes.push_back(std::make_unique<Lane>(nbBuckets, weight));
+	return _lanes.size() - 1;
+}
+
+template <typename T>
+typename PriorityRingSet<T>::Batch PriorityRingSet<T>::nextBatch(size_t max)
+{
+	if (_lanes.empty() || max == 0)
+	{
+		return Batch{ 0, nullptr, 0 };
+	}
+
+	return _mode == DrainMode::Strict ? strictBatch(max) : weightedBatch(max);
+}
+
+template <typename T>
+typename PriorityRingSet<T>::Batch PriorityRingSet<T>::strictBatch(size_t max)
+{
+	for (size_t i = 0; i < _lanes.size(); i++)
+	{
+		SpscRingBuffer<T>& ring = _lanes[i]->ring;
+
+		size_t available = ring.availableForRead();
+		if (available != 0)
+		{
+			return Batch{ i, ring.readBuffer(), available < max ? available : max };
+		}
+	}
+
+	return Batch{ 0, nullptr, 0 };
+}
+
+template <typename T>
+typename PriorityRingSet<T>::Batch PriorityRingSet<T>::weightedBatch(size_t max)
+{
+	// At most one full round of empty lanes before giving up.
+	for (size_t empty = 0; empty <= _lanes.size(); )
+	{
+		Lane& lane = *_lanes[_current];
+
+		size_t available = lane.ring.availableForRead();
+		if (available == 0)
+		{
+			// Idle lanes don't bank credit.
+			lane.deficit = 0;
+			nextLane();
+			empty++;
+			continue;
+		}
+
+		if (!_credited)
+		{
+			lane.deficit += lane.weight;
+			_credited = true;
+		}
+
+		size_t count = available < lane.deficit ? available : lane.deficit;
+		count = count < max ? count : max;
+
+		return Batch{ _current, lane.ring.readBuffer(), count };
+	}
+
+	return Batch{ 0, nullptr, 0 };
+}
+
+template <typename T>
+void PriorityRingSet<T>::consume(const Batch& batch)
+{
+	if (batch.count == 0)
+	{
+		return;
+	}
+
+	Lane& lane = *_lanes[batch.lane];
+	lane.ring.advanceReadHead(batch.count);
+
+	if (_mode == DrainMode::Weighted)
+	{
+		lane.deficit -= batch.count;
+		if (lane.deficit == 0)
+		{
+			nextLane();
+		}
+	}
+}
@@ -1,11 +1,37 @@
 #pragma once
 
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <source_location>
 #include <type_traits>
+
+#ifdef RINGBUFFER_TRACE_LATENCY
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#endif
 #include <Memoryapi.h>
 #include <WinBase.h>
 
+#include "CopyKernels.h"
+#include "RingCapture.h"
+#include "RingNotifier.h"
+#include "RingSnapshot.h"
 #include "VMemMirrorBuffer.h"
 
+// How RingBuffer rounds the size of its underlying buffer.
+enum class RingSizing {
+	// Smallest bucket count that fills whole pages.
+	Pages,
+	// Smallest power of 2 bucket count that fills whole pages. Might waste
+	// more memory but heads wrap with a mask instead of a division.
+	PowerOfTwo
+};
+
 template <typename T>
 class RingBuffer {
 	// Supports trivial types only because the underlying data structure is a bit finicky and
@@ -18,7 +44,12 @@ private:
 
 public:
 	
-	RingBuffer(size_t nbBuckets);
+	// Holds up to nbBuckets - 1 elements, any nbBuckets > 1 works. The underlying
+	// buffer is rounded up to whole pages (see RingSizing and bucketCount()) but
+	// the ring never holds more than nbBuckets - 1 elements.
+	// tag and site identify the ring's buffer in the MirrorRegistry.
+	RingBuffer(size_t nbBuckets, RingSizing sizing = RingSizing::Pages, const char* tag = nullptr,
+		std::source_location site = std::source_location::current());
 	RingBuffer(const RingBuffer &rhs);
 	RingBuffer(RingBuffer &&rhs);
 	~RingBuffer();
@@ -29,11 +60,18 @@ public:
 	bool isFull() const;
 
 	// Max amount of filled buckets in the buffer before overwriting happens.
-	size_t availableBuckets() const { return _nbBuckets - 1; }
+	// Always the nbBuckets - 1 asked for at construction.
+	size_t availableBuckets() const { return _capacity; }
+
+	// Total number of buckets in the underlying buffer, after rounding to pages.
+	size_t bucketCount() const { return _nbBuckets; }
+
+	// Number of buckets written since creation, never wraps around in practice.
+	uint64_t totalWritten() const { return _written; }
 
 	// Returns how many buckets can be filled before data is overwritten
 	// i.e. before the read head is moved. If the next write is to push 
-	// the read head, returns 0. Returns a maximum of nbBuckets - 1
+	// the read head, returns 0. Returns a maximum of availableBuckets
 	size_t availableForWrite() const;
 
 	// Returns how many buckets can be read
@@ -50,6 +88,33 @@ public:
 
 	void reset();
 
+	// Bulk copy in : same as filling writeBuffer() then advanceWriteHead(count),
+	// overwriting the oldest buckets if needed. Large batches are written with
+	// streaming stores, see CopyKernels. If count > availableBuckets only the
+	// last availableBuckets elements end up in the ring.
+	void writeBatch(const T* src, size_t count);
+
+	// Bulk copy out of up to count buckets. Returns how many were read.
+	size_t readBatch(T* dst, size_t count);
+
+	// Cheap view of the readable region, see RingSnapshot.
+	// Maps the ring's memory a second time instead of copying it.
+	RingSnapshot<T> snapshot() const;
+
+	// Gives the pages of the free region (everything but the readable buckets)
+	// back to the system, see VMemMirrorBuffer::discard. The ring stays fully
+	// usable, the pages get faulted back in when written to.
+	// Does nothing while snapshots of the ring are alive, they still read the
+	// free region. Returns the number of bytes released.
+	size_t releaseFreeMemory();
+
+	// Automatic releaseFreeMemory when the ring runs empty, but at most once
+	// every minWrittenBytes of traffic so a busy ring doesn't keep faulting
+	// pages back in. 0 (the default) disables it.
+	void setAutoRelease(size_t minWrittenBytes) { _autoReleaseBytes = minWrittenBytes; }
+
+	uint64_t totalReleasedBytes() const { return _releasedBytes; }
+
 	// For batch operations - direct access to buffer and to heads
 	// Only use if you know what you are doing.
 	// Batch write and reads (e.g. memcpy) to buffer don't need to wrap around.
@@ -60,6 +125,7 @@ public:
 	T* rawBuffer() { return _buffer.getBuffer<T>(); };
 	T* readBuffer() { return &_buffer.getBuffer<T>()[_read]; };
 	T* writeBuffer() { return &_buffer.getBuffer<T>()[_write]; };
+	const T* readBuffer() const { return &_buffer.getBuffer<T>()[_read]; };
 
 	// UB if offset > availableForRead.
 	void advanceReadHead(size_t offset);
@@ -67,53 +133,144 @@ public:
 	// UB if offset > availableBuckets
 	void advanceWriteHead(size_t offset);
 
+	// Optional readiness events, for use with WaitForMultipleObjects & co.
+	// readEvent is signaled while availableForRead >= readThreshold and
+	// writeEvent while availableForWrite >= writeThreshold. See RingNotifier.
+	// Events aren't carried over by copies.
+	void enableNotifications(size_t readThreshold = 1, size_t writeThreshold = 1);
+	void disableNotifications() { _notifier.reset(); }
+
+	// nullptr when notifications are disabled.
+	HANDLE readEvent() const { return _notifier ? _notifier->readEvent() : nullptr; }
+	HANDLE writeEvent() const { return _notifier ? _notifier->writeEvent() : nullptr; }
+
+	// Records every write, writeBatch and advanceWriteHead to capture, see RingCapture.
+	// nullptr stops recording. The ring doesn't own the capture, and copies
+	// don't carry it.
+	void setCapture(RingCapture* capture) { _capture = capture; }
+
+#ifdef RINGBUFFER_TRACE_LATENCY
+	// How long elements stayed in the ring, in ns, from the write that put
+	// them there to the read that took them out. Only built with
+	// RINGBUFFER_TRACE_LATENCY defined, as in the Trace configuration.
+	// Overwritten elements aren't counted.
+	const LatencyHistogram& latency() const { return _latency; }
+	void resetLatency() { _latency.reset(); }
+#endif
+
 private:
-	size_t inc(size_t base) const;
+	size_t inc(size_t base) const { return wrap(base + 1); }
+
+	// base % _nbBuckets, with a mask when the bucket count allows it.
+	size_t wrap(size_t base) const { return _mask != 0 ? (base & _mask) : (base % _nbBuckets); }
+
+	void notify()
+	{
+		if (_notifier)
+		{
+			_notifier->update(availableForRead(), availableForWrite());
+		}
+	}
+
+	// Tells snapshots, if any, that count buckets from the write head are about
+	// to be written. Goes before the writes, see RingSnapshot.
+	void announceWrites(size_t count)
+	{
+		if (_snapshotState)
+		{
+			_snapshotState->written.store(_written + count, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+	}
+
+	void autoRelease()
+	{
+		if (_autoReleaseBytes != 0 && _read == _write
+			&& (_written - _writtenAtRelease) * sizeof(T) >= _autoReleaseBytes)
+		{
+			releaseFreeMemory();
+		}
+	}
+
+	// advanceWriteHead without the capture : writeBatch records its batch itself.
+	void commitWrites(size_t offset);
+
+	// Latency tracing hooks. No-ops unless RINGBUFFER_TRACE_LATENCY is defined.
+	void stampWrites(size_t from, size_t count);
+	void recordReads(size_t from, size_t count);
 
 private:
 	// Number of buckets available for data type T - not the size in bytes
-	// of the buffer.
-	// nbBuckets - 1 will be available for use at once. 
+	// of the buffer. Rounded up so the buffer is a whole number of pages.
 	size_t _nbBuckets {0};
 
+	// Max filled buckets at once, nbBuckets - 1 as asked by the user. Less than
+	// _nbBuckets - 1 when the buffer had to be rounded up.
+	size_t _capacity {0};
+
+	// _nbBuckets - 1 when _nbBuckets is a power of 2, 0 otherwise.
+	size_t _mask {0};
+
 	// The buffer of the ring buffer
 	VMemMirrorBuffer _buffer{};
 
 	// Read and write heads
 	size_t _read {0};
 	size_t _write {0};
+
+	// Buckets written since creation. Lets snapshots tell what got overwritten.
+	uint64_t _written {0};
+
+	// Shared with the snapshots, null until the first one is taken.
+	mutable std::shared_ptr<RingSnapshotState> _snapshotState{};
+
+	// Free memory release policy and stats.
+	size_t _autoReleaseBytes {0};
+	uint64_t _writtenAtRelease {0};
+	uint64_t _releasedBytes {0};
+
+	std::unique_ptr<RingNotifier> _notifier{};
+
+	RingCapture* _capture{ nullptr };
+
+#ifdef RINGBUFFER_TRACE_LATENCY
+	// Write time of each bucket, parallel to the buffer.
+	std::vector<uint64_t> _stamps{};
+	LatencyHistogram _latency{};
+#endif
 };
 
 template <typename T>
-RingBuffer<T>::RingBuffer(size_t nbBuckets)
-	: _nbBuckets {nbBuckets}
+RingBuffer<T>::RingBuffer(size_t nbBuckets, RingSizing sizing, const char* tag, std::source_location site)
+	: _capacity {nbBuckets - 1}
 {
-	size_t bufferSize = nbBuckets * sizeof(T);
-	if (bufferSize == 0) 
+	if (nbBuckets < 2) 
 	{
-		throw std::runtime_error{ "size of buffer must be non-zero." };
-	}
-	else if (bufferSize % System::getPageSize() != 0) 
-	{
-		//todo math this out : increase nbBuckets so that buffer size is a whole 
-		//                     multiple of pagesize
-		throw std::runtime_error{ "nbBuckets * sizeof T must a whole multiple of pagesize" };
+		throw std::runtime_error{ "nbBuckets must be at least 2." };
 	}
 
-	_buffer.allocate(bufferSize);
+	// The mirror needs a whole number of pages. Page size and the granularity are
+	// powers of 2, so rounding to a power of 2 first keeps it a multiple.
+	_nbBuckets = (sizing == RingSizing::PowerOfTwo) ? std::bit_ceil(nbBuckets) : nbBuckets;
+	_nbBuckets = System::roundUpToPages(_nbBuckets, sizeof(T));
+	_mask = std::has_single_bit(_nbBuckets) ? _nbBuckets - 1 : 0;
+
+	_buffer.allocate(_nbBuckets * sizeof(T), tag, site);
+
+#ifdef RINGBUFFER_TRACE_LATENCY
+	_stamps.resize(_nbBuckets);
+#endif
 }
 
 template <typename T>
 RingBuffer<T>::RingBuffer(const RingBuffer<T>& rhs)
 {
-	this();
 	*this = rhs;
 }
 
 template <typename T>
 RingBuffer<T>::RingBuffer(RingBuffer<T>&& rhs)
 {
-	this();
 	*this = std::move(rhs);
 }
 
@@ -125,10 +282,23 @@ template <typename T>
 RingBuffer<T>& RingBuffer<T>::operator=(RingBuffer<T>&& rhs)
 {
 	std::swap(_nbBuckets, rhs._nbBuckets);
+	std::swap(_capacity, rhs._capacity);
+	std::swap(_mask, rhs._mask);
 	std::swap(_read, rhs._read);
 	std::swap(_write, rhs._write);
+	std::swap(_written, rhs._written);
+	std::swap(_snapshotState, rhs._snapshotState);
+	std::swap(_autoReleaseBytes, rhs._autoReleaseBytes);
+	std::swap(_writtenAtRelease, rhs._writtenAtRelease);
+	std::swap(_releasedBytes, rhs._releasedBytes);
+	std::swap(_notifier, rhs._notifier);
+	std::swap(_capture, rhs._capture);
 
-	_buffer = std::move(rhs);
+#ifdef RINGBUFFER_TRACE_LATENCY
+	std::swap(_stamps, rhs._stamps);
+#endif
+
+	_buffer = std::move(rhs._buffer);
 
 	return *this;
 }
@@ -137,10 +307,22 @@ template <typename T>
 RingBuffer<T>& RingBuffer<T>::operator=(const RingBuffer<T>& rhs)
 {
 	_nbBuckets = rhs._nbBuckets;
+	_capacity = rhs._capacity;
+	_mask = rhs._mask;
 	_read = rhs._read;
 	_write = rhs._write;
+	_written = rhs._written;
+	// The old buffer goes away, snapshots of it keep their own mapping and
+	// don't see the new writes.
+	_snapshotState.reset();
+	_autoReleaseBytes = rhs._autoReleaseBytes;
+	_writtenAtRelease = rhs._writtenAtRelease;
 	_buffer = rhs._buffer;
 
+#ifdef RINGBUFFER_TRACE_LATENCY
+	_stamps = rhs._stamps;
+#endif
+
 	return *this;
 }
 
@@ -153,42 +335,20 @@ bool RingBuffer<T>::hasData() const
 template <typename T>
 bool RingBuffer<T>::isFull() const
 {
-	return inc(_write) == _read;
+	return availableForRead() == _capacity;
 }
 
 template <typename T>
 size_t RingBuffer<T>::availableForWrite() const
 {
-	// TODO The whole fn could probably be simplified to :
-	// return _nbBuckets - 1 - availableForRead()
-	if (_read == _write) 
-	{
-		return _nbBuckets - 1;
-	}
-	else if (_write > _read) 
-	{
-		// we have to loop around. get remaining buckets + _write - 1
-		return _nbBuckets - _write + _read - 1;
-	}
-	else 
-	{
-		// distance - 1
-		return _read - _write - 1;
-	}
+	return _capacity - availableForRead();
 }
 
 template <typename T>
 size_t RingBuffer<T>::availableForRead() const
 {
-	if (_write >= _read)
-	{
-		return _write - _read;
-	}
-	else 
-	{
-		// we have to loop around.
-		return _nbBuckets - _read + _write;
-	}
+	// The + _nbBuckets takes care of the loop around.
+	return wrap(_write + _nbBuckets - _read);
 }
 
 template <typename T>
@@ -201,7 +361,10 @@ T&& RingBuffer<T>::read()
 
 	T* data = _buffer.getBuffer<T>();
 	size_t i = _read;
+	recordReads(i, 1);
 	_read = inc(_read);
+	notify();
+	autoRelease();
 
 	return std::move(data[i]);
 }
@@ -210,10 +373,19 @@ template <typename T>
 void RingBuffer<T>::write(const T& t)
 {
 	T* data = _buffer.getBuffer<T>();
+	bool full = isFull();
 
+	announceWrites(1);
 	data[_write] = t;
+	stampWrites(_write, 1);
+	if (_capture)
+	{
+		_capture->record(&data[_write], 1);
+	}
 	_write = inc(_write);
-	_read = (_write == _read) ? inc(_read) : _read;
+	_written++;
+	_read = full ? inc(_read) : _read;
+	notify();
 }
 
 template <typename T>
@@ -221,30 +393,160 @@ void RingBuffer<T>::reset()
 {
 	_read = 0;
 	_write = 0;
+	notify();
+}
+
+template <typename T>
+void RingBuffer<T>::writeBatch(const T* src, size_t count)
+{
+	// The batch as it arrived, before the ring trims it.
+	if (_capture)
+	{
+		_capture->record(src, count);
+	}
+
+	if (count > _capacity)
+	{
+		src += count - _capacity;
+		_written += count - _capacity;
+		count = _capacity;
+	}
+
+	announceWrites(count);
+	CopyKernels::copyBuckets(writeBuffer(), src, count);
+	commitWrites(count);
+}
+
+template <typename T>
+size_t RingBuffer<T>::readBatch(T* dst, size_t count)
+{
+	size_t available = availableForRead();
+	count = count < available ? count : available;
+
+	CopyKernels::copyBuckets(dst, readBuffer(), count);
+	advanceReadHead(count);
+
+	return count;
+}
+
+template <typename T>
+RingSnapshot<T> RingBuffer<T>::snapshot() const
+{
+	if (!_snapshotState)
+	{
+		_snapshotState = std::make_shared<RingSnapshotState>();
+		_snapshotState->written.store(_written, std::memory_order_relaxed);
+	}
+
+	size_t count = availableForRead();
+	return RingSnapshot<T>{ _snapshotState, _buffer.share(true), _read, count, _nbBuckets - count };
+}
+
+template <typename T>
+size_t RingBuffer<T>::releaseFreeMemory()
+{
+	if (_snapshotState && _snapshotState->snapshots.load(std::memory_order_acquire) != 0)
+	{
+		return 0;
+	}
+
+	size_t freeBuckets = _nbBuckets - availableForRead();
+	size_t released = _buffer.discard(_write * sizeof(T), freeBuckets * sizeof(T));
+
+	_writtenAtRelease = _written;
+	_releasedBytes += released;
+
+	return released;
 }
 
 template <typename T>
 void RingBuffer<T>::advanceReadHead(size_t offset)
 {
-	_read = (_read + offset) % _nbBuckets;
+	recordReads(_read, offset);
+	_read = wrap(_read + offset);
+	notify();
+	autoRelease();
 }
 
 template <typename T>
 void RingBuffer<T>::advanceWriteHead(size_t offset)
 {
-	size_t nextWrite = (_write + offset) % _nbBuckets;
+	if (_capture)
+	{
+		_capture->record(writeBuffer(), offset);
+	}
+
+	commitWrites(offset);
+}
+
+template <typename T>
+void RingBuffer<T>::commitWrites(size_t offset)
+{
+	size_t nextWrite = wrap(_write + offset);
 	size_t nextRead = _read;
 
 	if (offset > availableForWrite()) {
-		nextRead = inc(nextWrite);
+		// keep the newest _capacity buckets
+		nextRead = wrap(nextWrite + _nbBuckets - _capacity);
 	}
 
+	announceWrites(offset);
+	stampWrites(_write, offset);
 	_write = nextWrite;
 	_read = nextRead;
+	_written += offset;
+	notify();
+}
+
+template <typename T>
+void RingBuffer<T>::enableNotifications(size_t readThreshold, size_t writeThreshold)
+{
+	_notifier = std::make_unique<RingNotifier>(readThreshold, writeThreshold);
+	notify();
 }
 
 template <typename T>
-size_t RingBuffer<T>::inc(size_t base) const
+void RingBuffer<T>::stampWrites(size_t from, size_t count)
 {
-	return (base + 1) % _nbBuckets;
+#ifdef RINGBUFFER_TRACE_LATENCY
+	uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// A whole batch shares one stamp. Might have to wrap, the stamps aren't mirrored.
+	size_t first = std::min(count, _nbBuckets - from);
+	std::fill_n(_stamps.begin() + from, first, now);
+	std::fill_n(_stamps.begin(), count - first, now);
+#endif
+}
+
+template <typename T>
+void RingBuffer<T>::recordReads(size_t from, size_t count)
+{
+#ifdef RINGBUFFER_TRACE_LATENCY
+	if (count == 0)
+	{
+		return;
+	}
+
+	uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// Consecutive buckets from the same batch share a stamp, record them in one go.
+	uint64_t stamp = _stamps[from];
+	uint64_t run = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t s = _stamps[wrap(from + i)];
+		if (s != stamp)
+		{
+			_latency.record(now - stamp, run);
+			stamp = s;
+			run = 0;
+		}
+		run++;
+	}
+
+	_latency.record(now - stamp, run);
+#endif
 }
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <typename T>
+class RingBuffer;
+
+// Capture and replay of the traffic going into a ring.
+//
+// A RingCapture attached to a RingBuffer (RingBuffer::setCapture) records every
+// write / advanceWriteHead batch : when it happened, how many elements, and
+// optionally the elements themselves. replayCapture() plays the file back into
+// a ring with the same batch sizes and timing (or scaled timing), calling the
+// consumer after each batch, so a production arrival pattern becomes a local
+// benchmark.
+//
+// File layout, little endian :
+//   header  : "RCAP", uint32 version, uint32 element size, uint32 flags (1 = payload)
+//   records : varint ns since previous record, varint count, [count elements]
+// Varints are LEB128 : a steady stream of small batches costs 2-4 bytes per record.
+class RingCapture {
+public:
+	static constexpr uint32_t Version = 1;
+	static constexpr uint32_t PayloadFlag = 1;
+
+	RingCapture(const std::string& path, size_t elementSize, bool withPayload);
+	~RingCapture();
+
+	RingCapture(const RingCapture&) = delete;
+	RingCapture& operator=(const RingCapture&) = delete;
+
+	// count elements of elementSize bytes at data were just written.
+	void record(const void* data, size_t count);
+
+	void flush();
+
+	uint64_t recordCount() const { return _records; }
+
+private:
+	static uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void putVarint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			_pending.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		_pending.push_back(static_cast<uint8_t>(value));
+	}
+
+	void putU32(uint32_t value)
+	{
+		uint8_t bytes[4];
+		memcpy(bytes, &value, sizeof(bytes));
+		_pending.insert(_pending.end(), bytes, bytes + sizeof(bytes));
+	}
+
+private:
+	// Records are buffered and written in chunks of about that size.
+	static constexpr size_t FlushThreshold = 1 << 20;
+
+	std::ofstream _file;
+	size_t _elementSize;
+	bool _withPayload;
+
+	std::vector<uint8_t> _pending;
+	uint64_t _last;
+	uint64_t _records{ 0 };
+};
+
+inline RingCapture::RingCapture(const std::string& path, size_t elementSize, bool withPayload)
+	: _file{ path, std::ios::binary | std::ios::trunc }, _elementSize{ elementSize }, _withPayload{ withPayload }, _last{ now() }
+{
+	if (!_file)
+	{
+		throw std::runtime_error{ "Failed to open capture file" };
+	}
+
+	_pending.reserve(FlushThreshold);
+	_pending.insert(_pending.end(), { 'R', 'C', 'A', 'P' });
+	putU32(Version);
+	putU32(static_cast<uint32_t>(elementSize));
+	putU32(withPayload ? PayloadFlag : 0);
+}
+
+inline RingCapture::~RingCapture()
+{
+	flush();
+}
+
+inline void RingCapture::record(const void* data, size_t count)
+{
+	uint64_t t = now();
+	putVarint(t - _last);
+	putVarint(count);
+	_last = t;
+
+	if (_withPayload)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		_pending.insert(_pending.end(), bytes, bytes + count * _elementSize);
+	}
+
+	_records++;
+
+	if (_pending.size() >= FlushThreshold)
+	{
+		flush();
+	}
+}
+
+inline void RingCapture::flush()
+{
+	_file.write(reinterpret_cast<const char*>(_pending.data()), _pending.size());
+	_file.flush();
+	_pending.clear();
+}
+
+// One recorded batch.
+struct CaptureRecord {
+	// ns since the capture started.
+	uint64_t timestamp;
+	size_t count;
+	// count elements, unaligned. nullptr if the capture has no payload.
+	const uint8_t* payload;
+};
+
+// Reads a capture file, whole, in memory.
+class RingCaptureReader {
+public:
+	RingCaptureReader(const std::string& path);
+
+	size_t elementSize() const { return _elementSize; }
+	bool hasPayload() const { return _withPayload; }
+
+	// false once all records were read.
+	bool next(CaptureRecord& record);
+	void rewind();
+
+private:
+	uint64_t getVarint();
+
+private:
+	static constexpr size_t HeaderSize = 16;
+
+	std::vector<uint8_t> _data;
+	size_t _elementSize{ 0 };
+	bool _withPayload{ false };
+
+	size_t _offset{ HeaderSize };
+	uint64_t _timestamp{ 0 };
+};
+
+inline RingCaptureReader::RingCaptureReader(const std::string& path)
+{
+	std::ifstream file{ path, std::ios::binary };
+	if (!file)
+	{
+		throw std::runtime_error{ "Failed to open capture file" };
+	}
+
+	_data.assign(std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{});
+
+	uint32_t version = 0;
+	uint32_t elementSize = 0;
+	uint32_t flags = 0;
+	if (_data.size() < HeaderSize || memcmp(_data.data(), "RCAP", 4) != 0)
+	{
+		throw std::runtime_error{ "Not a capture file" };
+	}
+
+	memcpy(&version, &_data[4], sizeof(version));
+	memcpy(&elementSize, &_data[8], sizeof(elementSize));
+	memcpy(&flags, &_data[12], sizeof(flags));
+
+	if (version != RingCapture::Version)
+	{
+		throw std::runtime_error{ "Unsupported capture file version" };
+	}
+
+	_elementSize = elementSize;
+	_withPayload = (flags & RingCapture::PayloadFlag) != 0;
+}
+
+inline uint64_t RingCaptureReader::getVarint()
+{
+	uint64_t value = 0;
+
+	for (unsigned shift = 0; _offset < _data.size() && shift < 64; shift += 7)
+	{
+		uint8_t byte = _data[_offset++];
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+
+	throw std::runtime_error{ "Truncated capture file" };
+}
+
+inline bool RingCaptureReader::next(CaptureRecord& record)
+{
+	if (_offset >= _data.size())
+	{
+		return false;
+	}
+
+	_timestamp += getVarint();
+	record.timestamp = _timestamp;
+	record.count = static_cast<size_t>(getVarint());
+	record.payload = nullptr;
+
+	if (_withPayload)
+	{
+		size_t bytes = record.count * _elementSize;
+		if (_data.size() - _offset < bytes)
+		{
+			throw std::runtime_error{ "Truncated capture file" };
+		}
+
+		record.payload = &_data[_offset];
+		_offset += bytes;
+	}
+
+	return true;
+}
+
+inline void RingCaptureReader::rewind()
+{
+	_offset = HeaderSize;
+	_timestamp = 0;
+}
+
+struct ReplayStats {
+	uint64_t records;
+	uint64_t elements;
+	// How far behind the recorded schedule the replay got, at worst. Big values
+	// mean the consumer (or the machine) can't keep up with the pattern.
+	uint64_t maxLagNs;
+};
+
+// Plays capture into ring, from the start, then calls consumer(ring) after
+// every batch. speed scales the timing (2.0 is twice as fast), 0 replays as
+// fast as possible. Without payload in the capture, batches only move the write
+// head : the pattern is replayed, the contents are whatever is in the ring.
+template <typename T, typename Consumer>
+ReplayStats replayCapture(RingCaptureReader& capture, RingBuffer<T>& ring, Consumer&& consumer, double speed = 1.0)
+{
+	if (capture.elementSize() != sizeof(T))
+	{
+		throw std::runtime_error{ "Capture element size doesn't match the ring" };
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	ReplayStats stats{ 0, 0, 0 };
+	CaptureRecord record{};
+	Clock::time_point start = Clock::now();
+
+	capture.rewind();
+	while (capture.next(record))
+	{
+		if (speed > 0.0)
+		{
+			Clock::time_point target = start + std::chrono::nanoseconds{ static_cast<int64_t>(record.timestamp / speed) };
+
+			// Sleep through the long gaps, spin the last stretch : sleeps overshoot.
+			Clock::time_point now = Clock::now();
+			if (target - now > std::chrono::milliseconds{ 2 })
+			{
+				std::this_thread::sleep_until(target - std::chrono::milliseconds{ 1 });
+			}
+			while ((now = Clock::now()) < target) {}
+
+			uint64_t lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - target).count();
+			stats.maxLagNs = lag > stats.maxLagNs ? lag : stats.maxLagNs;
+		}
+
+		// Batches bigger than the ring (writeBatch records them whole) go in ring
+		// sized chunks, the newest elements end up in the ring like they did.
+		for (size_t done = 0; done < record.count;)
+		{
+			size_t count = record.count - done;
+			count = count < ring.availableBuckets() ? count : ring.availableBuckets();
+
+			if (record.payload)
+			{
+				memcpy(ring.writeBuffer(), record.payload + done * sizeof(T), count * sizeof(T));
+			}
+			ring.advanceWriteHead(count);
+			done += count;
+		}
+
+		stats.records++;
+		stats.elements += record.count;
+
+		consumer(ring);
+	}
+
+	return stats;
+}
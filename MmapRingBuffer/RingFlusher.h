@@ -0,0 +1,169 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "RingBuffer.h"
+#include "System.h"
+
+// Drains a RingBuffer<char> to a file opened with FILE_FLAG_NO_BUFFERING |
+// FILE_FLAG_WRITE_THROUGH : the data goes from the ring to the device, no copy
+// in the file cache, no lazy writer stalls later on.
+//
+// Unbuffered I/O wants the buffer address, the size and the file offset to be
+// multiples of the sector size. The ring's buffer is page aligned and a whole
+// number of pages, so as long as the read head sits on a block boundary (the
+// flusher being the only reader keeps it there) whole blocks are written
+// straight from readBuffer(). The mirror makes a run of blocks contiguous even
+// across the end of the buffer : one WriteFile, never a split write. If the read
+// head is misaligned anyway, the blocks go through an aligned bounce buffer.
+//
+// drain() only writes whole blocks. finish() writes the last partial block,
+// zero padded, then truncates the file to the exact size.
+class RingFlusher {
+public:
+	// blockSize must be a multiple of the device sector size, 0 for the page size.
+	RingFlusher(const std::string& path, size_t blockSize = 0);
+	~RingFlusher();
+
+	RingFlusher(const RingFlusher&) = delete;
+	RingFlusher& operator=(const RingFlusher&) = delete;
+
+	// Writes every whole block readable in ring. Returns the bytes written.
+	size_t drain(RingBuffer<char>& ring);
+
+	// Writes everything left, tail included, and sets the file size. Nothing can
+	// be written after that.
+	void finish(RingBuffer<char>& ring);
+
+	// Bytes of the ring written so far, padding not included.
+	uint64_t bytesWritten() const { return _offset; }
+
+private:
+	// Writes bytes (a multiple of the block size) from an aligned buffer.
+	void writeBlocks(const char* data, size_t bytes);
+
+private:
+	// Max bytes per WriteFile.
+	static constexpr size_t MaxWrite = 1 << 20;
+
+	HANDLE _file{ INVALID_HANDLE_VALUE };
+	size_t _blockSize;
+	uint64_t _offset{ 0 };
+	bool _finished{ false };
+
+	char* _bounce{ nullptr };
+	size_t _bounceSize{ 0 };
+};
+
+inline RingFlusher::RingFlusher(const std::string& path, size_t blockSize)
+	: _blockSize{ blockSize == 0 ? System::getPageSize() : blockSize }
+{
+	_file = CreateFileA(
+		path.c_str(),
+		GENERIC_WRITE,
+		0,				// no sharing
+		nullptr,
+		CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH,
+		nullptr
+	);
+
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error{ "couldn't open flusher file" };
+	}
+
+	// VirtualAlloc memory is page aligned, good for any sector size.
+	_bounceSize = (64 * 1024 + _blockSize - 1) / _blockSize * _blockSize;
+	_bounce = static_cast<char*>(VirtualAlloc(nullptr, _bounceSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+
+	if (_bounce == nullptr)
+	{
+		CloseHandle(_file);
+		throw std::runtime_error{ "couldn't allocate flusher bounce buffer" };
+	}
+}
+
+inline RingFlusher::~RingFlusher()
+{
+	VirtualFree(_bounce, 0, MEM_RELEASE);
+	CloseHandle(_file);
+}
+
+inline size_t RingFlusher::drain(RingBuffer<char>& ring)
+{
+	if (_finished)
+	{
+		throw std::runtime_error{ "RingFlusher already finished" };
+	}
+
+	size_t bytes = ring.availableForRead() / _blockSize * _blockSize;
+	const char* data = ring.readBuffer();
+
+	if (reinterpret_cast<uintptr_t>(data) % _blockSize == 0)
+	{
+		writeBlocks(data, bytes);
+	}
+	else
+	{
+		for (size_t done = 0; done < bytes; done += _bounceSize)
+		{
+			size_t chunk = (bytes - done < _bounceSize) ? bytes - done : _bounceSize;
+			memcpy(_bounce, data + done, chunk);
+			writeBlocks(_bounce, chunk);
+		}
+	}
+
+	ring.advanceReadHead(bytes);
+	_offset += bytes;
+
+	return bytes;
+}
+
+inline void RingFlusher::finish(RingBuffer<char>& ring)
+{
+	drain(ring);
+
+	size_t tail = ring.availableForRead();
+	if (tail != 0)
+	{
+		memcpy(_bounce, ring.readBuffer(), tail);
+		memset(_bounce + tail, 0, _blockSize - tail);
+		writeBlocks(_bounce, _blockSize);
+
+		ring.advanceReadHead(tail);
+		_offset += tail;
+	}
+
+	// Cut the padding. The file pointer doesn't have to be aligned for that.
+	LARGE_INTEGER end{};
+	end.QuadPart = static_cast<LONGLONG>(_offset);
+	if (!SetFilePointerEx(_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(_file))
+	{
+		throw std::runtime_error{ "couldn't set flusher file size" };
+	}
+
+	_finished = true;
+}
+
+inline void RingFlusher::writeBlocks(const char* data, size_t bytes)
+{
+	while (bytes != 0)
+	{
+		DWORD chunk = static_cast<DWORD>(bytes < MaxWrite ? bytes : MaxWrite);
+		DWORD written = 0;
+
+		if (!WriteFile(_file, data, chunk, &written, nullptr) || written != chunk)
+		{
+			throw std::runtime_error{ "flusher write failed" };
+		}
+
+		data += chunk;
+		bytes -= chunk;
+	}
+}
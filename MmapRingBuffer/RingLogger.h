@@ -0,0 +1,414 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "SpscRingBuffer.h"
+
+// Asynchronous logger : the hot thread only copies a format id and the raw
+// arguments in a ring, a backend thread does the formatting and the file I/O.
+//
+//   RingLogger log{ "out.log" };
+//   RING_LOG(log, "order {} filled at {} ({} lots)", id, price, lots);
+//
+// Each thread logging to a logger gets its own SpscRingBuffer<uint8_t>, records
+// are written in place through writeBuffer() / advanceWriteHead(), contiguous
+// thanks to the mirror. No lock, no allocation, no formatting on the hot path.
+// When a thread exits its ring goes to the next thread that starts logging, a
+// logger has at most as many rings as threads logging to it at once.
+// When the thread's ring is full the record is dropped and counted (dropped()),
+// logging never blocks.
+//
+// Arguments must be trivial types (numbers, chars, pointers, small structs) : they
+// are copied as raw bytes. "{}" in the format is replaced by the next argument.
+// The format must be a string literal, it's registered once per call site.
+class RingLogger {
+public:
+	// Text of a registered format and how to print its arguments.
+	using DecodeFn = void (*)(std::string& out, const char* format, const uint8_t* args);
+
+	// ringBytes is per logging thread.
+	RingLogger(const std::string& path, size_t ringBytes = 1 << 20);
+
+	// Drains everything then stops the backend.
+	~RingLogger();
+
+	RingLogger(const RingLogger&) = delete;
+	RingLogger& operator=(const RingLogger&) = delete;
+
+	// Use RING_LOG. Site is a lambda returning the format, unique to the call site.
+	template <typename Site, typename... Args>
+	bool log(Site site, const char* format, const Args&... args);
+
+	// Blocks until everything logged before the call is written to the file.
+	void flush();
+
+	uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+	// Rings created so far, in use or waiting for a new thread.
+	size_t ringCount() const { return _ringCount.load(std::memory_order_acquire); }
+
+	// Format registry, shared by all loggers.
+	static uint32_t registerFormat(const char* format, DecodeFn decode);
+
+	template <typename... Args>
+	static void decode(std::string& out, const char* format, const uint8_t* args);
+
+private:
+	struct RecordHeader {
+		uint32_t formatId;
+		uint32_t size;
+	};
+
+	struct Format {
+		const char* text;
+		DecodeFn decode;
+	};
+
+	// A thread's ring. Shared between the logger and the thread's cache, whichever
+	// goes last frees it.
+	struct ThreadRing {
+		ThreadRing(size_t bytes) : ring{ bytes } {}
+
+		SpscRingBuffer<uint8_t> ring;
+		// A thread is writing to it. Cleared when that thread exits, the ring
+		// then goes to the next thread asking for one.
+		std::atomic<bool> owned{ true };
+		// Cleared when the logger is destroyed.
+		std::atomic<bool> live{ true };
+	};
+
+	// Per thread : the ring of each logger the thread logged to.
+	struct ThreadRings {
+		struct Entry {
+			uint64_t logger;
+			std::shared_ptr<ThreadRing> ring;
+		};
+
+		~ThreadRings();
+
+		std::vector<Entry> entries;
+	};
+
+	static std::mutex& formatsMutex() { static std::mutex m; return m; }
+	static std::vector<Format>& formats() { static std::vector<Format> f; return f; }
+
+	// Appends format up to the next "{}" and moves format past it.
+	static void appendUntilPlaceholder(std::string& out, const char*& format);
+
+	template <typename T>
+	static void appendArg(std::string& out, const T& value);
+
+	SpscRingBuffer<uint8_t>& threadRing();
+	std::shared_ptr<ThreadRing> acquireRing();
+
+	void backendLoop();
+	bool drain();
+
+private:
+	// Written out once the pending text gets that big, and after every pass.
+	static constexpr size_t WriteChunk = 64 * 1024;
+
+	// Tells the thread local ring caches of different loggers apart, even if
+	// one is created where another was.
+	uint64_t _id;
+	size_t _ringBytes;
+
+	std::ofstream _file;
+	std::string _pending;
+
+	std::mutex _ringsMutex;
+	std::vector<std::shared_ptr<ThreadRing>> _rings;
+	std::atomic<size_t> _ringCount{ 0 };
+
+	std::atomic<uint64_t> _dropped{ 0 };
+	std::atomic<uint64_t> _passes{ 0 };
+	std::atomic<bool> _stop{ false };
+	std::thread _backend;
+};
+
+#define RING_LOG(logger, ...) \
+	(logger).log([]() -> const char* { return RING_LOG_EXPAND(RING_LOG_FORMAT(__VA_ARGS__, 0)); }, __VA_ARGS__)
+
+// First of the arguments. The extra expansion is for MSVC's preprocessor, which
+// passes __VA_ARGS__ on as a single argument otherwise.
+#define RING_LOG_FORMAT(format, ...) format
+#define RING_LOG_EXPAND(x) x
+
+inline RingLogger::RingLogger(const std::string& path, size_t ringBytes)
+	: _ringBytes{ ringBytes }, _file{ path, std::ios::binary | std::ios::trunc }
+{
+	static std::atomic<uint64_t> nextId{ 1 };
+	_id = nextId.fetch_add(1, std::memory_order_relaxed);
+
+	if (!_file)
+	{
+		throw std::runtime_error{ "Failed to open log file" };
+	}
+
+	_pending.reserve(2 * WriteChunk);
+	_backend = std::thread{ [this] { backendLoop(); } };
+}
+
+inline RingLogger::~RingLogger()
+{
+	_stop.store(true, std::memory_order_release);
+	_backend.join();
+
+	for (std::shared_ptr<ThreadRing>& ring : _rings)
+	{
+		ring->live.store(false, std::memory_order_release);
+	}
+}
+
+template <typename Site, typename... Args>
+bool RingLogger::log(Site, const char*, const Args&... args)
+{
+	static_assert((std::is_trivial<Args>::value && ...), "RingLogger arguments must be trivial types.");
+
+	static const uint32_t formatId = registerFormat(Site{}(), &decode<Args...>);
+	constexpr size_t size = sizeof(RecordHeader) + (sizeof(Args) + ... + 0);
+
+	SpscRingBuffer<uint8_t>& ring = threadRing();
+	if (ring.availableForWrite(size) < size)
+	{
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	uint8_t* p = ring.writeBuffer();
+	RecordHeader header{ formatId, static_cast<uint32_t>(size) };
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+	((memcpy(p, &args, sizeof(Args)), p += sizeof(Args)), ...);
+
+	ring.advanceWriteHead(size);
+	return true;
+}
+
+inline RingLogger::ThreadRings::~ThreadRings()
+{
+	for (Entry& entry : entries)
+	{
+		entry.ring->owned.store(false, std::memory_order_release);
+	}
+}
+
+inline SpscRingBuffer<uint8_t>& RingLogger::threadRing()
+{
+	thread_local ThreadRings rings;
+
+	// Rarely more than a couple of loggers : a scan beats a map.
+	for (ThreadRings::Entry& entry : rings.entries)
+	{
+		if (entry.logger == _id)
+		{
+			return entry.ring->ring;
+		}
+	}
+
+	// New logger for this thread, forget the ones that are gone on the way.
+	std::erase_if(rings.entries, [](const ThreadRings::Entry& entry) {
+		return !entry.ring->live.load(std::memory_order_acquire);
+	});
+
+	rings.entries.push_back(ThreadRings::Entry{ _id, acquireRing() });
+	return rings.entries.back().ring->ring;
+}
+
+inline std::shared_ptr<RingLogger::ThreadRing> RingLogger::acquireRing()
+{
+	std::lock_guard<std::mutex> lock{ _ringsMutex };
+
+	// A ring left by an exited thread, records it didn't get drained yet included :
+	// this thread just takes over as its producer.
+	for (std::shared_ptr<ThreadRing>& ring : _rings)
+	{
+		if (!ring->owned.load(std::memory_order_acquire))
+		{
+			ring->owned.store(true, std::memory_order_relaxed);
+			return ring;
+		}
+	}
+
+	_rings.push_back(std::make_shared<ThreadRing>(_ringBytes));
+	_ringCount.store(_rings.size(), std::memory_order_release);
+
+	return _rings.back();
+}
+
+inline uint32_t RingLogger::registerFormat(const char* format, DecodeFn decode)
+{
+	std::lock_guard<std::mutex> lock{ formatsMutex() };
+
+	formats().push_back(Format{ format, decode });
+	return static_cast<uint32_t>(formats().size() - 1);
+}
+
+template <typename... Args>
+void RingLogger::decode(std::string& out, const char* format, const uint8_t* args)
+{
+	auto next = [&](auto tag) {
+		using T = typename decltype(tag)::type;
+		T value;
+		memcpy(&value, args, sizeof(T));
+		args += sizeof(T);
+
+		appendUntilPlaceholder(out, format);
+		appendArg(out, value);
+	};
+
+	(next(std::type_identity<Args>{}), ...);
+
+	// Rest of the format, unused placeholders included.
+	out.append(format);
+}
+
+inline void RingLogger::appendUntilPlaceholder(std::string& out, const char*& format)
+{
+	const char* placeholder = strstr(format, "{}");
+	if (placeholder == nullptr)
+	{
+		// More arguments than placeholders : they go at the end.
+		out.append(format);
+		out.push_back(' ');
+		format += strlen(format);
+		return;
+	}
+
+	out.append(format, placeholder);
+	format = placeholder + 2;
+}
+
+template <typename T>
+void RingLogger::appendArg(std::string& out, const T& value)
+{
+	char buffer[64];
+
+	if constexpr (std::is_same<T, bool>::value)
+	{
+		out.append(value ? "true" : "false");
+	}
+	else if constexpr (std::is_same<T, char>::value)
+	{
+		out.push_back(value);
+	}
+	else if constexpr (std::is_arithmetic<T>::value)
+	{
+		std::to_chars_result r = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, r.ptr);
+	}
+	else if constexpr (std::is_pointer<T>::value)
+	{
+		std::to_chars_result r = std::to_chars(buffer, buffer + sizeof(buffer), reinterpret_cast<uintptr_t>(value), 16);
+		out.append("0x");
+		out.append(buffer, r.ptr);
+	}
+	else if constexpr (std::is_enum<T>::value)
+	{
+		appendArg(out, static_cast<std::underlying_type_t<T>>(value));
+	}
+	else
+	{
+		out.append("{?}");
+	}
+}
+
+inline bool RingLogger::drain()
+{
+	bool any = false;
+
+	size_t count = _ringCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++)
+	{
+		SpscRingBuffer<uint8_t>* ring;
+		{
+			std::lock_guard<std::mutex> lock{ _ringsMutex };
+			ring = &_rings[i]->ring;
+		}
+
+		size_t available = ring->availableForRead();
+		const uint8_t* data = ring->readBuffer();
+		size_t offset = 0;
+
+		while (offset < available)
+		{
+			RecordHeader header;
+			memcpy(&header, data + offset, sizeof(header));
+
+			Format format;
+			{
+				std::lock_guard<std::mutex> lock{ formatsMutex() };
+				format = formats()[header.formatId];
+			}
+
+			format.decode(_pending, format.text, data + offset + sizeof(header));
+			_pending.push_back('\n');
+			offset += header.size;
+		}
+
+		ring->advanceReadHead(available);
+		any = any || available != 0;
+
+		if (_pending.size() >= WriteChunk)
+		{
+			_file.write(_pending.data(), _pending.size());
+			_pending.clear();
+		}
+	}
+
+	// Under load a pass drains a lot : that's the big write.
+	if (!_pending.empty())
+	{
+		_file.write(_pending.data(), _pending.size());
+		_file.flush();
+		_pending.clear();
+	}
+
+	return any;
+}
+
+inline void RingLogger::backendLoop()
+{
+	for (;;)
+	{
+		// Read before draining : when it's set, this pass sees every last record.
+		bool stop = _stop.load(std::memory_order_acquire);
+		bool any = drain();
+
+		_passes.fetch_add(1, std::memory_order_release);
+
+		if (stop)
+		{
+			return;
+		}
+
+		if (!any)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+		}
+	}
+}
+
+inline void RingLogger::flush()
+{
+	// The pass after the current one started after this call : it drains and
+	// writes out everything logged before it.
+	uint64_t target = _passes.load(std::memory_order_acquire) + 2;
+
+	while (_passes.load(std::memory_order_acquire) < target)
+	{
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <windows.h>
+#include <stdexcept>
+
+// Readiness signalling for RingBuffer so a ring can sit in the same
+// WaitForMultipleObjects loop as sockets, timers and whatnot.
+//
+// Holds 2 manual reset events:
+//  - readEvent is signaled while availableForRead >= readThreshold
+//  - writeEvent is signaled while availableForWrite >= writeThreshold
+//
+// The signaled state is cached so SetEvent/ResetEvent are only called when
+// a threshold is actually crossed. A ring that stays busy (or stays idle)
+// doesn't do any syscall.
+//
+// This is the winapi equivalent of an eventfd.
+class RingNotifier {
+public:
+	RingNotifier(size_t readThreshold, size_t writeThreshold);
+	~RingNotifier();
+
+	RingNotifier(const RingNotifier&) = delete;
+	RingNotifier& operator=(const RingNotifier&) = delete;
+
+	HANDLE readEvent() const { return _readEvent; }
+	HANDLE writeEvent() const { return _writeEvent; }
+
+	// Called by the ring after every head movement.
+	void update(size_t availableForRead, size_t availableForWrite)
+	{
+		bool readable = availableForRead >= _readThreshold;
+		bool writable = availableForWrite >= _writeThreshold;
+
+		if (readable != _readSignaled)
+		{
+			readable ? SetEvent(_readEvent) : ResetEvent(_readEvent);
+			_readSignaled = readable;
+		}
+
+		if (writable != _writeSignaled)
+		{
+			writable ? SetEvent(_writeEvent) : ResetEvent(_writeEvent);
+			_writeSignaled = writable;
+		}
+	}
+
+private:
+	size_t _readThreshold{ 1 };
+	size_t _writeThreshold{ 1 };
+
+	HANDLE _readEvent{ nullptr };
+	HANDLE _writeEvent{ nullptr };
+
+	bool _readSignaled{ false };
+	bool _writeSignaled{ false };
+};
+
+inline RingNotifier::RingNotifier(size_t readThreshold, size_t writeThreshold)
+	: _readThreshold{ readThreshold }
+	, _writeThreshold{ writeThreshold }
+{
+	if (readThreshold == 0 || writeThreshold == 0)
+	{
+		throw std::runtime_error{ "RingNotifier thresholds must be non-zero" };
+	}
+
+	// manual reset, initially non signaled, anonymous
+	_readEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	_writeEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	if (_readEvent == nullptr || _writeEvent == nullptr)
+	{
+		if (_readEvent != nullptr) CloseHandle(_readEvent);
+		if (_writeEvent != nullptr) CloseHandle(_writeEvent);
+		throw std::runtime_error{ "couldn't create ring notification events" };
+	}
+}
+
+inline RingNotifier::~RingNotifier()
+{
+	CloseHandle(_readEvent);
+	CloseHandle(_writeEvent);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "VMemMirrorBuffer.h"
+
+// What a ring shares with its snapshots. Created by the first snapshot() and
+// carried along when the ring moves, so snapshots never point at the ring itself.
+struct RingSnapshotState {
+	// The ring's totalWritten(), bumped before the elements are written.
+	std::atomic<uint64_t> written{ 0 };
+
+	// Snapshots alive. The ring doesn't discard free pages while there's any :
+	// that's where the snapshots' elements are once the ring has been drained.
+	std::atomic<size_t> snapshots{ 0 };
+};
+
+// View of a RingBuffer's readable region as it was, see RingBuffer::snapshot().
+//
+// Doesn't copy anything : the snapshot maps a second, read only, pair of mirrored
+// views over the ring's memory and remembers where the heads were. Creating one
+// costs a couple of mappings no matter how big the ring is.
+//
+// The ring keeps going at full speed afterwards, the snapshot can be handed to
+// another thread. Since the memory is shared, once the producer has filled the
+// free space it starts overwriting the oldest elements of the snapshot. The ring
+// announces its writes (seqlock style) before making them : lostCount() tells
+// how many of the snapshot's oldest elements are gone, or being overwritten,
+// and intact() only returns the ones that are still exactly as they were.
+// Elements written through writeBuffer() directly are only announced by
+// advanceWriteHead, after the fact.
+//
+// Copy-on-write (FILE_MAP_COPY) doesn't help here, it only protects the section
+// from writes made through the copy, not the other way around.
+//
+// The snapshot keeps its own handle on the ring's memory, it can outlive the ring.
+template <typename T>
+class RingSnapshot {
+public:
+	RingSnapshot(std::shared_ptr<RingSnapshotState> state, VMemMirrorBuffer&& view, size_t read, size_t count, size_t slack);
+
+	RingSnapshot(const RingSnapshot&) = delete;
+	RingSnapshot& operator=(const RingSnapshot&) = delete;
+	RingSnapshot(RingSnapshot&& rhs) = default;
+	RingSnapshot& operator=(RingSnapshot&& rhs);
+	~RingSnapshot();
+
+	// Number of elements in the ring when the snapshot was taken.
+	size_t size() const { return _count; }
+
+	// How many of the oldest elements have been overwritten since the snapshot.
+	size_t lostCount() const;
+
+	// Elements that haven't been overwritten yet, oldest first.
+	// If the ring is written to while you go through the span, check lostCount()
+	// again once done : the first lostCount() elements can't be trusted.
+	std::span<const T> intact() const;
+
+private:
+	std::shared_ptr<RingSnapshotState> _state;
+	VMemMirrorBuffer _view;
+
+	size_t _read;
+	size_t _count;
+
+	// Free buckets in the ring at snapshot time. The producer can write that
+	// many before touching the snapshot's data.
+	size_t _slack;
+	uint64_t _written;
+};
+
+template <typename T>
+RingSnapshot<T>::RingSnapshot(std::shared_ptr<RingSnapshotState> state, VMemMirrorBuffer&& view, size_t read, size_t count, size_t slack)
+	: _state{ std::move(state) }
+	, _view{ std::move(view) }
+	, _read{ read }
+	, _count{ count }
+	, _slack{ slack }
+	, _written{ _state->written.load(std::memory_order_relaxed) }
+{
+	_state->snapshots.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+RingSnapshot<T>& RingSnapshot<T>::operator=(RingSnapshot<T>&& rhs)
+{
+	// rhs takes our state along, its destructor lets go of it.
+	std::swap(_state, rhs._state);
+	std::swap(_view, rhs._view);
+	std::swap(_read, rhs._read);
+	std::swap(_count, rhs._count);
+	std::swap(_slack, rhs._slack);
+	std::swap(_written, rhs._written);
+
+	return *this;
+}
+
+template <typename T>
+RingSnapshot<T>::~RingSnapshot()
+{
+	// Null once moved from.
+	if (_state)
+	{
+		_state->snapshots.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+template <typename T>
+size_t RingSnapshot<T>::lostCount() const
+{
+	// Seqlock reader : whatever was read from the view before this call is
+	// checked against the writes announced so far.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t written = _state->written.load(std::memory_order_relaxed) - _written;
+
+	if (written <= _slack)
+	{
+		return 0;
+	}
+
+	return written - _slack < _count ? static_cast<size_t>(written - _slack) : _count;
+}
+
+template <typename T>
+std::span<const T> RingSnapshot<T>::intact() const
+{
+	size_t lost = lostCount();
+
+	return { _view.getBuffer<T>() + _read + lost, _count - lost };
+}
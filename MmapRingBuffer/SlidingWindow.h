@@ -0,0 +1,280 @@
+#pragma once
+
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "RingBuffer.h"
+
+// Reduction and convolution kernels over a contiguous window.
+//
+// Written so the compiler can vectorize them : independent accumulators, no
+// aliasing between input and output and no wrap around (the mirror takes care
+// of that). Build with /arch:AVX2 to get the explicit AVX2 float paths.
+namespace WindowKernels {
+
+	template <typename T>
+	T sum(const T* data, size_t n)
+	{
+		// 8 accumulators : breaks the add dependency chain and maps on a
+		// 256 bit register for 32 bit types.
+		T acc[8]{};
+		size_t i = 0;
+
+		for (; i + 8 <= n; i += 8)
+		{
+			for (size_t j = 0; j < 8; j++)
+			{
+				acc[j] += data[i + j];
+			}
+		}
+
+		T total = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+		for (; i < n; i++)
+		{
+			total += data[i];
+		}
+
+		return total;
+	}
+
+	// Returns {min, max}. Both are T{} for an empty range.
+	template <typename T>
+	std::pair<T, T> minMax(const T* data, size_t n)
+	{
+		if (n == 0)
+		{
+			return { T{}, T{} };
+		}
+
+		T lo[8], hi[8];
+		for (size_t j = 0; j < 8; j++)
+		{
+			lo[j] = data[0];
+			hi[j] = data[0];
+		}
+
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			for (size_t j = 0; j < 8; j++)
+			{
+				lo[j] = data[i + j] < lo[j] ? data[i + j] : lo[j];
+				hi[j] = data[i + j] > hi[j] ? data[i + j] : hi[j];
+			}
+		}
+
+		for (; i < n; i++)
+		{
+			lo[0] = data[i] < lo[0] ? data[i] : lo[0];
+			hi[0] = data[i] > hi[0] ? data[i] : hi[0];
+		}
+
+		for (size_t j = 1; j < 8; j++)
+		{
+			lo[0] = lo[j] < lo[0] ? lo[j] : lo[0];
+			hi[0] = hi[j] > hi[0] ? hi[j] : hi[0];
+		}
+
+		return { lo[0], hi[0] };
+	}
+
+#if defined(__AVX2__)
+	template <>
+	inline float sum<float>(const float* data, size_t n)
+	{
+		__m256 acc0 = _mm256_setzero_ps();
+		__m256 acc1 = _mm256_setzero_ps();
+		size_t i = 0;
+
+		for (; i + 16 <= n; i += 16)
+		{
+			acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(data + i));
+			acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(data + i + 8));
+		}
+
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, _mm256_add_ps(acc0, acc1));
+
+		float total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+		for (; i < n; i++)
+		{
+			total += data[i];
+		}
+
+		return total;
+	}
+
+	template <>
+	inline std::pair<float, float> minMax<float>(const float* data, size_t n)
+	{
+		if (n < 8)
+		{
+			float lo = n ? data[0] : 0.f;
+			float hi = lo;
+			for (size_t i = 1; i < n; i++)
+			{
+				lo = data[i] < lo ? data[i] : lo;
+				hi = data[i] > hi ? data[i] : hi;
+			}
+			return { lo, hi };
+		}
+
+		__m256 lo = _mm256_loadu_ps(data);
+		__m256 hi = lo;
+		size_t i = 8;
+
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 v = _mm256_loadu_ps(data + i);
+			lo = _mm256_min_ps(lo, v);
+			hi = _mm256_max_ps(hi, v);
+		}
+
+		// Tail : reload the last 8 floats, overlapping is harmless for min/max.
+		__m256 v = _mm256_loadu_ps(data + n - 8);
+		lo = _mm256_min_ps(lo, v);
+		hi = _mm256_max_ps(hi, v);
+
+		alignas(32) float los[8];
+		alignas(32) float his[8];
+		_mm256_store_ps(los, lo);
+		_mm256_store_ps(his, hi);
+
+		for (size_t j = 1; j < 8; j++)
+		{
+			los[0] = los[j] < los[0] ? los[j] : los[0];
+			his[0] = his[j] > his[0] ? his[j] : his[0];
+		}
+
+		return { los[0], his[0] };
+	}
+#endif
+
+	// FIR filter : out[i] = sum over k of taps[k] * data[i + k]
+	// for i in [0, n - nbTaps]. Writes n - nbTaps + 1 values, nothing if n < nbTaps.
+	//
+	// The loops are ordered tap-major so the inner loop is a broadcast multiply
+	// add over contiguous input, which vectorizes at full width.
+	template <typename T>
+	size_t fir(const T* data, size_t n, const T* taps, size_t nbTaps, T* out)
+	{
+		if (nbTaps == 0 || n < nbTaps)
+		{
+			return 0;
+		}
+
+		size_t nbOut = n - nbTaps + 1;
+
+		for (size_t i = 0; i < nbOut; i++)
+		{
+			out[i] = T{};
+		}
+
+		for (size_t k = 0; k < nbTaps; k++)
+		{
+			const T tap = taps[k];
+			const T* in = data + k;
+
+			for (size_t i = 0; i < nbOut; i++)
+			{
+				out[i] += tap * in[i];
+			}
+		}
+
+		return nbOut;
+	}
+};
+
+// The last `windowSize` elements written, as one contiguous span, with a running
+// sum kept up to date on every write.
+//
+// The underlying ring only ever holds the window : the readable region *is* the
+// window, so there is nothing to copy and no wrap to check before handing it to
+// WindowKernels. The rest of the ring is headroom for batch writes.
+//
+// For floating point types the running sum drifts a little over time, call
+// recompute() every now and then if that matters.
+template <typename T>
+class SlidingWindow {
+public:
+	// nbBuckets follows the RingBuffer rules and must leave room for the window.
+	SlidingWindow(size_t windowSize, size_t nbBuckets);
+
+	void push(const T& value);
+
+	// Batch path : fill up to maxBatch() elements in writeBuffer() then commit.
+	T* writeBuffer() { return _ring.writeBuffer(); }
+	size_t maxBatch() const { return _ring.availableForWrite(); }
+	void commit(size_t count);
+
+	std::span<const T> window() const { return { _ring.readBuffer(), _ring.availableForRead() }; }
+	size_t size() const { return _ring.availableForRead(); }
+	size_t windowSize() const { return _windowSize; }
+
+	T sum() const { return _sum; }
+	double mean() const { return size() ? static_cast<double>(_sum) / size() : 0.0; }
+	std::pair<T, T> minMax() const { return WindowKernels::minMax(_ring.readBuffer(), size()); }
+
+	void recompute() { _sum = WindowKernels::sum(_ring.readBuffer(), size()); }
+
+private:
+	RingBuffer<T> _ring;
+	size_t _windowSize;
+	T _sum{};
+};
+
+template <typename T>
+SlidingWindow<T>::SlidingWindow(size_t windowSize, size_t nbBuckets)
+	: _ring{ nbBuckets }
+	, _windowSize{ windowSize }
+{
+	if (windowSize == 0 || windowSize > _ring.availableBuckets())
+	{
+		throw std::runtime_error{ "SlidingWindow size must be in [1, nbBuckets - 1]" };
+	}
+}
+
+template <typename T>
+void SlidingWindow<T>::push(const T& value)
+{
+	if (size() == _windowSize)
+	{
+		_sum -= _ring.readBuffer()[0];
+		_ring.advanceReadHead(1);
+	}
+
+	_ring.write(value);
+	_sum += value;
+}
+
+template <typename T>
+void SlidingWindow<T>::commit(size_t count)
+{
+	if (count > _ring.availableForWrite())
+	{
+		throw std::runtime_error{ "SlidingWindow batch larger than maxBatch" };
+	}
+
+	size_t current = size();
+	size_t excess = current + count > _windowSize ? current + count - _windowSize : 0;
+
+	if (excess >= current)
+	{
+		// The whole previous window falls off, cheaper to start over.
+		_ring.advanceWriteHead(count);
+		_ring.advanceReadHead(excess);
+		recompute();
+		return;
+	}
+
+	_sum += WindowKernels::sum(_ring.writeBuffer(), count);
+	_sum -= WindowKernels::sum(_ring.readBuffer(), excess);
+
+	_ring.advanceWriteHead(count);
+	_ring.advanceReadHead(excess);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include "SpscRingBuffer.h"
+
+// Fixed slot message pool for one producer thread and one consumer thread,
+// instead of new-ing messages and passing pointers around.
+//
+//   SlotPool<Order> pool{ 4096 };
+//   // producer
+//   if (Order* o = pool.claim()) { o->id = ...; pool.publish(); }
+//   // consumer
+//   while (Order* o = pool.front()) { handle(*o); pool.release(); }
+//
+// Slots live in an SpscRingBuffer, each one cache line aligned and padded to a
+// whole number of lines so producer and consumer never share a line. Messages are
+// built in place, read in place, and released in FIFO order : the slot memory is
+// walked sequentially and nothing is allocated after construction.
+template <typename Msg>
+class SlotPool {
+	static_assert(std::is_trivial<Msg>::value, "SlotPool must be templated on a trivial type.");
+
+	struct alignas(64) Slot {
+		Msg msg;
+	};
+
+public:
+	SlotPool(size_t nbSlots) : _slots{ nbSlots } {}
+
+	SlotPool(const SlotPool&) = delete;
+	SlotPool& operator=(const SlotPool&) = delete;
+
+	size_t slotCount() const { return _slots.bucketCount(); }
+
+	// Producer side. claim() hands out the next free slot, nullptr if there
+	// isn't any. Several slots can be claimed before publish(), which hands
+	// them all to the consumer, in claim order.
+	Msg* claim();
+	void publish();
+
+	// Consumer side. front() is the oldest published message, nullptr if
+	// there's none. release() gives its slot back to the producer.
+	Msg* front();
+	void release();
+
+private:
+	SpscRingBuffer<Slot> _slots;
+
+	// Claimed and not published yet.
+	size_t _claimed{ 0 };
+};
+
+template <typename Msg>
+Msg* SlotPool<Msg>::claim()
+{
+	if (_claimed >= _slots.availableForWrite(_claimed + 1))
+	{
+		return nullptr;
+	}
+
+	return &_slots.writeBuffer()[_claimed++].msg;
+}
+
+template <typename Msg>
+void SlotPool<Msg>::publish()
+{
+	_slots.advanceWriteHead(_claimed);
+	_claimed = 0;
+}
+
+template <typename Msg>
+Msg* SlotPool<Msg>::front()
+{
+	return _slots.availableForRead() != 0 ? &_slots.readBuffer()->msg : nullptr;
+}
+
+template <typename Msg>
+void SlotPool<Msg>::release()
+{
+	_slots.advanceReadHead(1);
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "RingBuffer.h"
+#include "VMemMirrorBuffer.h"
+
+// Thread safe flavour of RingBuffer for exactly one producer thread and one
+// consumer thread.
+//
+// Never overwrites : writes fail (or batches get smaller) when the ring is full,
+// the consumer sets the pace. Heads are monotonic counters on their own cache
+// lines, each side keeps a cached copy of the other side's head and only reloads
+// it when it looks like it ran out, so a steady stream mostly touches local lines.
+//
+// Same batch API as RingBuffer : thanks to the mirror, readBuffer() and
+// writeBuffer() are contiguous for availableForRead() / availableForWrite()
+// elements. All bucketCount() buckets are usable.
+template <typename T>
+class SpscRingBuffer {
+	static_assert(std::is_trivial<T>::value, "SpscRingBuffer must be templated on a trivial type.");
+
+public:
+	// Rounds the size up the same way RingBuffer does.
+	SpscRingBuffer(size_t nbBuckets, RingSizing sizing = RingSizing::Pages);
+
+	SpscRingBuffer(const SpscRingBuffer&) = delete;
+	SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+	size_t bucketCount() const { return _nbBuckets; }
+
+	// Approximate fill level, from any thread.
+	size_t size() const;
+
+	// Producer side. The consumer's head is only reloaded when fewer than
+	// atLeast buckets look free.
+	size_t availableForWrite(size_t atLeast = 1);
+	T* writeBuffer() { return &_buffer.getBuffer<T>()[wrap(_write.load(std::memory_order_relaxed))]; }
+	// UB if offset > availableForWrite.
+	void advanceWriteHead(size_t offset);
+	// false when full.
+	bool write(const T& t);
+
+	// Consumer side.
+	size_t availableForRead();
+	T* readBuffer() { return &_buffer.getBuffer<T>()[wrap(_read.load(std::memory_order_relaxed))]; }
+	// UB if offset > availableForRead.
+	void advanceReadHead(size_t offset);
+	// false when empty.
+	bool read(T& t);
+
+private:
+	size_t wrap(uint64_t position) const { return static_cast<size_t>(_mask != 0 ? (position & _mask) : (position % _nbBuckets)); }
+
+private:
+	size_t _nbBuckets{ 0 };
+	size_t _mask{ 0 };
+	VMemMirrorBuffer _buffer{};
+
+	// Producer's line
+	alignas(64) std::atomic<uint64_t> _write{ 0 };
+	uint64_t _readCache{ 0 };
+
+	// Consumer's line
+	alignas(64) std::atomic<uint64_t> _read{ 0 };
+	uint64_t _writeCache{ 0 };
+};
+
+template <typename T>
+SpscRingBuffer<T>::SpscRingBuffer(size_t nbBuckets, RingSizing sizing)
+{
+	if (nbBuckets == 0)
+	{
+		throw std::runtime_error{ "size of buffer must be non-zero." };
+	}
+
+	_nbBuckets = (sizing == RingSizing::PowerOfTwo) ? std::bit_ceil(nbBuckets) : nbBuckets;
+	_nbBuckets = System::roundUpToPages(_nbBuckets, sizeof(T));
+	_mask = std::has_single_bit(_nbBuckets) ? _nbBuckets - 1 : 0;
+
+	_buffer.allocate(_nbBuckets * sizeof(T));
+}
+
+template <typename T>
+size_t SpscRingBuffer<T>::size() const
+{
+	// Read head first : it only moves towards the write head.
+	uint64_t read = _read.load(std::memory_order_acquire);
+	uint64_t write = _write.load(std::memory_order_acquire);
+	return static_cast<size_t>(write - read);
+}
+
+template <typename T>
+size_t SpscRingBuffer<T>::availableForWrite(size_t atLeast)
+{
+	uint64_t write = _write.load(std::memory_order_relaxed);
+
+	if (_nbBuckets - (write - _readCache) < atLeast)
+	{
+		_readCache = _read.load(std::memory_order_acquire);
+	}
+
+	return static_cast<size_t>(_nbBuckets - (write - _readCache));
+}
+
+template <typename T>
+void SpscRingBuffer<T>::advanceWriteHead(size_t offset)
+{
+	_write.store(_write.load(std::memory_order_relaxed) + offset, std::memory_order_release);
+}
+
+template <typename T>
+bool SpscRingBuffer<T>::write(const T& t)
+{
+	if (availableForWrite() == 0)
+	{
+		return false;
+	}
+
+	*writeBuffer() = t;
+	advanceWriteHead(1);
+	return true;
+}
+
+template <typename T>
+size_t SpscRingBuffer<T>::availableForRead()
+{
+	uint64_t read = _read.load(std::memory_order_relaxed);
+
+	if (read >= _writeCache)
+	{
+		_writeCache = _write.load(std::memory_order_acquire);
+	}
+
+	return static_cast<size_t>(_writeCache - read);
+}
+
+template <typename T>
+void SpscRingBuffer<T>::advanceReadHead(size_t offset)
+{
+	_read.store(_read.load(std::memory_order_relaxed) + offset, std::memory_order_release);
+}
+
+template <typename T>
+bool SpscRingBuffer<T>::read(T& t)
+{
+	if (availableForRead() == 0)
+	{
+		return false;
+	}
+
+	t = *readBuffer();
+	advanceReadHead(1);
+	return true;
+}
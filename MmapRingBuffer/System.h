@@ -1,6 +1,7 @@
 #pragma once
 
 #include <windows.h>
+#include <numeric>
 
 namespace System {
 	size_t getPageSize()
@@ -16,4 +17,18 @@ namespace System {
 
 		return pageSize;
 	}
+
+	// Smallest number of elements of elementSize bytes that fill a whole number
+	// of pages. Always a power of 2 since the page size is one.
+	size_t pageGranularity(size_t elementSize)
+	{
+		return getPageSize() / std::gcd(getPageSize(), elementSize);
+	}
+
+	// Rounds count up to a multiple of pageGranularity(elementSize).
+	size_t roundUpToPages(size_t count, size_t elementSize)
+	{
+		size_t granularity = pageGranularity(elementSize);
+		return (count + granularity - 1) / granularity * granularity;
+	}
 };
\ No newline at end of file
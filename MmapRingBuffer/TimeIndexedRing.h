@@ -0,0 +1,124 @@
+#pragma once
+
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "RingBuffer.h"
+
+// Default key for TimeIndexedRing : samples have a `timestamp` member.
+template <typename T>
+struct SampleTimestamp {
+	auto operator()(const T& sample) const { return sample.timestamp; }
+};
+
+// RingBuffer of samples kept sorted by timestamp.
+//
+// Because the readable region of the ring is one contiguous array (thanks
+// VMemMirrorBuffer), a time range query is a binary search over
+// readBuffer() .. readBuffer() + availableForRead(). No copy, no wrap around
+// handling, and the result is a plain span into the ring.
+//
+// Timestamps must be pushed in non-decreasing order. When the ring is full,
+// the oldest samples are overwritten just like RingBuffer::write does.
+template <typename T, typename KeyOf = SampleTimestamp<T>>
+class TimeIndexedRing {
+public:
+	using Key = std::decay_t<decltype(std::declval<const KeyOf&>()(std::declval<const T&>()))>;
+
+	TimeIndexedRing(size_t nbBuckets, KeyOf keyOf = KeyOf{});
+
+	// Throws if the sample is older than the newest one in the ring.
+	void push(const T& sample);
+
+	size_t size() const { return _ring.availableForRead(); }
+	bool empty() const { return !_ring.hasData(); }
+
+	// Every sample currently in the ring, oldest first.
+	std::span<const T> samples() const { return { _ring.readBuffer(), _ring.availableForRead() }; }
+
+	// Samples with from <= timestamp < to. Nothing is consumed.
+	// The span is only valid until the next push or eviction.
+	std::span<const T> range(Key from, Key to) const;
+
+	// Drops every sample with timestamp < cutoff. Returns how many were dropped.
+	size_t evictOlderThan(Key cutoff);
+
+	RingBuffer<T>& ring() { return _ring; }
+
+private:
+	// Index of the first sample with timestamp >= t, size() if there are none.
+	size_t lowerBound(Key t) const;
+
+private:
+	RingBuffer<T> _ring;
+	KeyOf _keyOf;
+};
+
+template <typename T, typename KeyOf>
+TimeIndexedRing<T, KeyOf>::TimeIndexedRing(size_t nbBuckets, KeyOf keyOf)
+	: _ring{ nbBuckets }
+	, _keyOf{ keyOf }
+{
+}
+
+template <typename T, typename KeyOf>
+void TimeIndexedRing<T, KeyOf>::push(const T& sample)
+{
+	size_t count = _ring.availableForRead();
+
+	if (count > 0 && _keyOf(sample) < _keyOf(_ring.readBuffer()[count - 1]))
+	{
+		throw std::runtime_error{ "TimeIndexedRing samples must be pushed in timestamp order" };
+	}
+
+	_ring.write(sample);
+}
+
+template <typename T, typename KeyOf>
+std::span<const T> TimeIndexedRing<T, KeyOf>::range(Key from, Key to) const
+{
+	if (!(from < to))
+	{
+		return {};
+	}
+
+	size_t first = lowerBound(from);
+	size_t last = lowerBound(to);
+
+	return { _ring.readBuffer() + first, last - first };
+}
+
+template <typename T, typename KeyOf>
+size_t TimeIndexedRing<T, KeyOf>::evictOlderThan(Key cutoff)
+{
+	size_t count = lowerBound(cutoff);
+	_ring.advanceReadHead(count);
+
+	return count;
+}
+
+template <typename T, typename KeyOf>
+size_t TimeIndexedRing<T, KeyOf>::lowerBound(Key t) const
+{
+	const T* data = _ring.readBuffer();
+	size_t n = _ring.availableForRead();
+
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	// Branchless lower bound : the loop trip count only depends on n and the
+	// compare turns into a cmov, so there is nothing to mispredict.
+	const T* base = data;
+	while (n > 1)
+	{
+		size_t half = n / 2;
+		base = (_keyOf(base[half]) < t) ? base + half : base;
+		n -= half;
+	}
+
+	return (base - data) + (_keyOf(*base) < t ? 1 : 0);
+}
@@ -2,8 +2,11 @@
 
 #include <WinBase.h>
 #include <cstdint>
+#include <source_location>
 #include <stdexcept>
 
+#include "CopyKernels.h"
+#include "MirrorRegistry.h"
 #include "System.h"
 
 // This one is hard to name XD
@@ -22,9 +25,27 @@ public:
 	VMemMirrorBuffer& operator= (const VMemMirrorBuffer & rhs);
 	VMemMirrorBuffer& operator= (VMemMirrorBuffer && rhs);
 
-	bool allocate(size_t size);
+	// tag and site identify the buffer in the MirrorRegistry, when it's enabled.
+	// The tag pointer is kept for copies : a string literal, or something that
+	// outlives the buffer. Throws if the registry's budget would be exceeded.
+	bool allocate(size_t size, const char* tag = nullptr, std::source_location site = std::source_location::current());
 	void free();
 
+	// Returns another mirror buffer mapping the same memory at a different address.
+	// Nothing is copied : writes through one are visible through the other.
+	// With readOnly, the new views are mapped PAGE_READONLY.
+	// The new buffer keeps the section alive on its own, so it's registered in
+	// the MirrorRegistry (and checked against the budget) under this buffer's tag.
+	VMemMirrorBuffer share(bool readOnly = true) const;
+
+	// Tells the system the content of [offset, offset + length) is garbage so the
+	// physical pages can be reclaimed instead of written to the paging file, and
+	// drops them from the working set of both views. The range may wrap past the
+	// end of the first view. Only whole pages inside the range are discarded.
+	// The memory stays mapped and usable, its content is undefined afterwards.
+	// Returns the number of bytes discarded.
+	size_t discard(size_t offset, size_t length);
+
 	bool isAllocated() const {
 		return _allocated;
 	}
@@ -38,10 +59,20 @@ public:
 		return reinterpret_cast<T*>(_actualBuffer);
 	}
 
+	template <typename T>
+	const T* getBuffer() const {
+		return reinterpret_cast<const T*>(_actualBuffer);
+	}
+
 	size_t getPageSize() const { return _size; }
 	size_t getVMemSize() const { return _size * 2; }
 
 private:
+	// Maps both mirrored views of section. Takes ownership of the handle.
+	bool mapSection(HANDLE section, size_t size, ULONG protection);
+
+	// discard() for a range that doesn't cross the end of the first view.
+	size_t discardPages(size_t offset, size_t length);
 
 
 private:
@@ -57,6 +88,11 @@ private:
 	void* _firstSegment{ nullptr };
 	void* _secondSegment{ nullptr };
 
+	// Whether allocate() put this buffer in the MirrorRegistry, and as what.
+	// Copies are registered the same way.
+	bool _registered{ false };
+	const char* _tag{ nullptr };
+	std::source_location _site{};
 };
 
 VMemMirrorBuffer::VMemMirrorBuffer(size_t size)
@@ -85,9 +121,9 @@ VMemMirrorBuffer& VMemMirrorBuffer::operator= (const VMemMirrorBuffer& rhs)
 
 	if (rhs.isAllocated()) {
 		_size = rhs._size;
-		allocate(_size);
+		allocate(_size, rhs._tag, rhs._site);
 
-		memcpy(_actualBuffer, rhs._actualBuffer, _size);
+		CopyKernels::copy(_actualBuffer, rhs._actualBuffer, _size);
 	}
 
 	return *this;
@@ -105,17 +141,113 @@ VMemMirrorBuffer& VMemMirrorBuffer::operator= (VMemMirrorBuffer&& rhs)
 	std::swap(_view2, rhs._view2);
 	std::swap(_firstSegment, rhs._firstSegment);
 	std::swap(_secondSegment, rhs._secondSegment);
+	std::swap(_registered, rhs._registered);
+	std::swap(_tag, rhs._tag);
+	std::swap(_site, rhs._site);
 
 	return *this;
 }
 
-bool VMemMirrorBuffer::allocate(size_t size)
+bool VMemMirrorBuffer::allocate(size_t size, const char* tag, std::source_location site)
 {
 	if (size % System::getPageSize() != 0) {
 		throw std::runtime_error{ "VMemMirrorBuffer alloc size must be a multiple of System::pageSize" };
 	}
 
 	free();
+
+	_tag = tag;
+	_site = site;
+
+	// Budget check before the section exists : a rejected buffer must not take
+	// any commit, even briefly.
+	bool registering = MirrorRegistry::enabled();
+	if (registering) {
+		MirrorRegistry::instance().reserve(size);
+	}
+
+	try {
+		// create page mapping section
+
+		uint32_t lowBitsSize = static_cast<uint32_t>(0xFFFFFFFF & size);
+		uint32_t highBitsSize = static_cast<uint32_t>(0xFFFFFFFF & (size >> 32));
+
+		HANDLE section = CreateFileMapping(
+			INVALID_HANDLE_VALUE,	// Create file mapping backed by a paging file
+			nullptr,				// no inherit
+			PAGE_READWRITE,			// rw access
+			highBitsSize,			// high order bytes of size
+			lowBitsSize,			// Low-order bytes of size
+			nullptr					// anonymous region
+		);
+
+		if (section == NULL) {
+			throw std::runtime_error{ "couldn't allocate file mapping" };
+		}
+
+		mapSection(section, size, PAGE_READWRITE);
+	}
+	catch (std::runtime_error&) {
+		if (registering) {
+			MirrorRegistry::instance().unreserve(size);
+		}
+		throw;
+	}
+
+	if (registering) {
+		MirrorRegistry::instance().add(_actualBuffer, _size, tag, site);
+		_registered = true;
+	}
+
+	return true;
+}
+
+VMemMirrorBuffer VMemMirrorBuffer::share(bool readOnly) const
+{
+	VMemMirrorBuffer shared{};
+
+	if (!_allocated) {
+		return shared;
+	}
+
+	bool registering = MirrorRegistry::enabled();
+	if (registering) {
+		MirrorRegistry::instance().reserve(_size);
+	}
+
+	try {
+		// The new buffer gets its own handle on the section so either one can be
+		// freed first.
+		HANDLE section = NULL;
+		if (!DuplicateHandle(GetCurrentProcess(), _pageFile, GetCurrentProcess(), &section, 0, FALSE, DUPLICATE_SAME_ACCESS))
+		{
+			throw std::runtime_error{ "couldn't duplicate file mapping handle" };
+		}
+
+		shared.mapSection(section, _size, readOnly ? PAGE_READONLY : PAGE_READWRITE);
+	}
+	catch (std::runtime_error&) {
+		if (registering) {
+			MirrorRegistry::instance().unreserve(_size);
+		}
+		throw;
+	}
+
+	shared._tag = _tag;
+	shared._site = _site;
+
+	if (registering) {
+		MirrorRegistry::instance().add(shared._actualBuffer, _size, _tag, _site);
+		shared._registered = true;
+	}
+
+	return shared;
+}
+
+bool VMemMirrorBuffer::mapSection(HANDLE section, size_t size, ULONG protection)
+{
+	// Takes ownership of section right away so free() closes it on failure.
+	_pageFile = section;
 	_size = size;
 
 	try {
@@ -143,33 +275,15 @@ bool VMemMirrorBuffer::allocate(size_t size)
 		_firstSegment = _actualBuffer;
 		_secondSegment = (char*)_actualBuffer + _size;
 
-		// step 3 - create page mapping section
-
-		uint32_t lowBitsSize = static_cast<uint32_t>(0xFFFFFFFF & _size);
-		uint32_t highBitsSize = static_cast<uint32_t>(0xFFFFFFFF & (_size >> 32));
-
-		_pageFile = CreateFileMapping(
-			INVALID_HANDLE_VALUE,	// Create file mapping backed by a paging file
-			nullptr,				// no inherit
-			PAGE_READWRITE,			// rw access
-			highBitsSize,			// high order bytes of size
-			lowBitsSize,			// Low-order bytes of size
-			nullptr					// anonymous region
-		);
-
-		if (_pageFile == NULL) {
-			throw std::runtime_error{ "couldn't allocate file mapping" };
-		}
-
-		// Step 4 map segments to page
+		// map segments to page
 		_view1 = (char*)MapViewOfFile3(
 			_pageFile,
 			nullptr,
 			_firstSegment,
-			highBitsSize,
-			lowBitsSize,
+			0,						// offset in the section
+			_size,					// view size
 			MEM_REPLACE_PLACEHOLDER,
-			PAGE_READWRITE,
+			protection,
 			nullptr, 0
 		);
 
@@ -177,10 +291,10 @@ bool VMemMirrorBuffer::allocate(size_t size)
 			_pageFile,
 			nullptr,
 			_secondSegment,
-			highBitsSize,
-			lowBitsSize,
+			0,
+			_size,
 			MEM_REPLACE_PLACEHOLDER,
-			PAGE_READWRITE,
+			protection,
 			nullptr, 0
 		);
 
@@ -205,8 +319,57 @@ bool VMemMirrorBuffer::allocate(size_t size)
 	}
 }
 
+size_t VMemMirrorBuffer::discard(size_t offset, size_t length)
+{
+	if (!_allocated || length == 0) {
+		return 0;
+	}
+
+	offset %= _size;
+	length = length > _size ? _size : length;
+
+	// Split at the end of the first view, the 2 views are separate mappings.
+	size_t first = (offset + length > _size) ? _size - offset : length;
+
+	return discardPages(offset, first) + discardPages(0, length - first);
+}
+
+size_t VMemMirrorBuffer::discardPages(size_t offset, size_t length)
+{
+	size_t pageSize = System::getPageSize();
+
+	// round inward, never touch a page that's partly in use
+	size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+	size_t end = (offset + length) / pageSize * pageSize;
+
+	if (end <= begin) {
+		return 0;
+	}
+
+	size_t size = end - begin;
+	char* page1 = static_cast<char*>(_view1) + begin;
+	char* page2 = static_cast<char*>(_view2) + begin;
+
+	// Both views are backed by the same section pages, resetting through one is enough.
+	if (VirtualAlloc(page1, size, MEM_RESET, PAGE_READWRITE) == nullptr) {
+		return 0;
+	}
+
+	// VirtualUnlock on pages that aren't locked removes them from the working set.
+	// It "fails" with ERROR_NOT_LOCKED, that's expected.
+	VirtualUnlock(page1, size);
+	VirtualUnlock(page2, size);
+
+	return size;
+}
+
 void VMemMirrorBuffer::free()
 {
+	if (_registered) {
+		MirrorRegistry::instance().remove(_actualBuffer);
+		_registered = false;
+	}
+
 	if (_view1 != nullptr) {
 		UnmapViewOfFileEx(_view1, 0);
 		_view1 = nullptr;